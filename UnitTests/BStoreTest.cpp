@@ -0,0 +1,541 @@
+#include <iostream>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <BStore.h>
+#include <BStoreReader.h>
+
+using namespace ToolFramework;
+
+int test_counter=0;
+
+template <typename T> int Test(T a, T b, std::string message=""){
+test_counter++;
+
+if(a!=b){
+    std::cout<<"ERROR "<<test_counter<<" "<<message<<": "<<a<<"!="<<b<<std::endl;
+    return test_counter;
+}
+return 0;
+
+}
+
+
+static bool CopyFile(const std::string& from, const std::string& to){
+
+  std::ifstream in(from.c_str(), std::ios::binary);
+  std::ofstream out(to.c_str(), std::ios::binary);
+  out << in.rdbuf();
+  return in.good() && out.good();
+
+}
+
+int main(){
+
+int ret=0;
+
+// zero copy views of stored values
+BStore view_store(true, true);
+std::vector<float> v(100, 4.4);
+std::string h="hello world";
+view_store.Set("v", v);
+view_store.Set("h", h);
+BinaryView<float> v2;
+BinaryView<char> h2;
+ret+=Test(view_store.Get("v", v2), true, "view get");
+ret+=Test(view_store.Get("h", h2), true, "string view get");
+ret+=Test(v2.size(), v.size(), "view size");
+ret+=Test(v2[99], v[99], "view value");
+ret+=Test(std::string(h2.begin(), h2.end()), h, "string view value");
+BinaryView<int> wrong;
+ret+=Test(view_store.Get("v", wrong), false, "view of wrong type");
+
+// in memory mode values are held until needed in serialised form
+BStore mem(true, true);
+mem.SetInMemory(true);
+std::vector<int> held(10, 3);
+ret+=Test(mem.Set("held", held), true, "hold value");
+ret+=Test(mem.m_variables.count("held"), (size_t)0, "held value not serialised");
+std::vector<int> held2;
+ret+=Test(mem.Get("held", held2), true, "get held value");
+ret+=Test(held2==held, true, "held value");
+std::vector<int>* held_ptr=0;
+ret+=Test(mem.Get("held", held_ptr), true, "get held pointer");
+(*held_ptr)[0]=7;
+std::string json;
+ret+=Test(mem.JsonEncode(json), true, "json encode held values");
+ret+=Test(mem.m_variables.count("held"), (size_t)1, "held value materialised");
+BinaryView<int> held_view;
+ret+=Test(mem.Get("held", held_view), true, "view of held value");
+ret+=Test(held_view[0], 7, "held value changed through pointer");
+BStore held_inner(true, true);
+held_inner.Set("a", 2);
+ret+=Test(mem.Set("inner", held_inner), true, "nested store in memory mode");
+BStore held_inner2(true, true);
+int a=0;
+ret+=Test(mem.Get("inner", held_inner2), true, "get nested store in memory mode");
+ret+=Test(held_inner2.Get("a", a), true, "nested store value");
+ret+=Test(a, 2, "nested store value read");
+
+// nested stores with lookups past 4GB (mocked) keep their full offsets
+BStore outer(true, true);
+BStore inner(true, true);
+inner.Set("a", 1);
+inner.Save(0);
+inner.m_lookup.push_back(5000000000ULL);
+ret+=Test(outer.Set("inner", inner), true, "set nested store with 64 bit lookup");
+BStore inner2(true, true);
+ret+=Test(outer.Get("inner", inner2), true, "get nested store with 64 bit lookup");
+ret+=Test(inner2.m_lookup.size(), inner.m_lookup.size(), "64 bit lookup size");
+ret+=Test(inner2.m_lookup.back(), (uint64_t)5000000000ULL, "64 bit lookup offset");
+ret+=Test(inner2.m_lookup.front(), inner.m_lookup.front(), "64 bit lookup first offset");
+
+BStore small(true, true);
+small.Set("a", 1);
+small.Save(0);
+ret+=Test(outer.Set("small", small), true, "set nested store with 32 bit lookup");
+BStore small2(true, true);
+ret+=Test(outer.Get("small", small2), true, "get nested store with 32 bit lookup");
+ret+=Test(small2.m_lookup.size(), small.m_lookup.size(), "32 bit lookup size");
+ret+=Test(small2.m_lookup.front(), small.m_lookup.front(), "32 bit lookup offset");
+
+// files written by version 1 still read, v1_store.bs holds three entries of i, v and s and a header with run=7
+BStore v1(true, true);
+ret+=Test(v1.Initnew("v1_store.bs", uncompressed_mmap, true, true), true, "version 1 file open");
+ret+=Test(v1.NumEntries(), 3U, "version 1 file entries");
+int v1_run=0;
+ret+=Test(v1.Header->Get("run", v1_run), true, "version 1 header get");
+ret+=Test(v1_run, 7, "version 1 header value");
+for(unsigned int i=0; i<3; i++){
+  int v1_i=-1;
+  std::vector<double> v1_v;
+  std::string v1_s;
+  ret+=Test(v1.GetEntry(2-i), true, "version 1 get entry");
+  ret+=Test(v1.Get("i", v1_i), true, "version 1 get int");
+  ret+=Test(v1_i, (int)(2-i), "version 1 int value");
+  ret+=Test(v1.Get("v", v1_v), true, "version 1 get vector");
+  ret+=Test(v1_v==std::vector<double>(3-i, 1.5*(2-i)), true, "version 1 vector value");
+  ret+=Test(v1.Get("s", v1_s), true, "version 1 get string");
+  ret+=Test(v1_s, std::string("entry")+char('0'+2-i), "version 1 string value");
+  ret+=Test(v1.Get("i", v1_s), false, "version 1 type checking");
+}
+v1.Close();
+
+// lazy entries read each key on first access
+BStore lazy_out(true, true);
+ret+=Test(lazy_out.Initnew("lazy_test.bs", uncompressed, true, true), true, "lazy file open");
+for(unsigned int i=0; i<4; i++){
+  lazy_out.Set("i", static_cast<int>(i));
+  lazy_out.Set("s", std::string(i+1, 'x'));
+  ret+=Test(lazy_out.Save(i), true, "lazy file save");
+}
+ret+=Test(lazy_out.Close(), true, "lazy file close");
+BStore lazy_in(true, true);
+lazy_in.SetLazy(true);
+ret+=Test(lazy_in.Initnew("lazy_test.bs", uncompressed, true, true), true, "lazy file reopen");
+ret+=Test(lazy_in.NumEntries(), 4U, "lazy file entries");
+ret+=Test(lazy_in.GetEntry(2), true, "lazy get entry");
+ret+=Test(lazy_in.m_variables.size(), (size_t)0, "lazy entry not read");
+int lazy_i=-1;
+ret+=Test(lazy_in.Get("i", lazy_i), true, "lazy get");
+ret+=Test(lazy_i, 2, "lazy value");
+ret+=Test(lazy_in.m_variables.count("s"), (size_t)0, "lazy unaccessed key not read");
+ret+=Test(lazy_in.Has("s"), true, "lazy has");
+ret+=Test(lazy_in.LoadKeys(), true, "lazy load keys");
+ret+=Test(lazy_in.m_variables.size(), (size_t)2, "lazy entry loaded");
+std::string lazy_s;
+ret+=Test(lazy_in.Get("s", lazy_s), true, "lazy get string");
+ret+=Test(lazy_s, std::string(3, 'x'), "lazy string value");
+ret+=Test(lazy_in.GetEntry(0), true, "lazy get other entry");
+ret+=Test(lazy_in.Get("s", lazy_s), true, "lazy get other entry string");
+ret+=Test(lazy_s, std::string(1, 'x'), "lazy other entry string value");
+ret+=Test(lazy_in.Get("missing", lazy_s), false, "lazy get missing key");
+lazy_in.Close();
+remove("lazy_test.bs");
+
+// reading a column leaves the current entry as it is
+for(int type=0; type<2; type++){
+  BStore column_store(true, true);
+  ret+=Test(column_store.Initnew("column_test.bs", type ? columnar : uncompressed, true, true), true, "column file open");
+  column_store.SetColumnRows(2);
+  for(unsigned int i=0; i<5; i++){
+    column_store.Set("i", static_cast<int>(i*i));
+    if(i%2) column_store.Set("odd", static_cast<int>(i));
+    ret+=Test(column_store.Save(i), true, "column file save");
+    column_store.Delete();
+  }
+  int pending=42;
+  column_store.Set("pending", pending);
+  std::vector<int> column;
+  ret+=Test(column_store.GetColumn("i", column), true, "get column");
+  ret+=Test(column.size(), (size_t)5, "column size");
+  ret+=Test(column[3], 9, "column value");
+  ret+=Test(column_store.GetColumn("odd", column), true, "get sparse column");
+  ret+=Test(column[3], 3, "sparse column value");
+  ret+=Test(column[2], 0, "sparse column missing value");
+  std::vector<std::string> wrong_column;
+  ret+=Test(column_store.GetColumn("i", wrong_column), false, "column of wrong type");
+  pending=0;
+  ret+=Test(column_store.Get("pending", pending), true, "unsaved value kept by get column");
+  ret+=Test(pending, 42, "unsaved value");
+  column_store.Close();
+  remove("column_test.bs");
+}
+
+// entries read ahead are the ones asked for, in and out of order
+BStore prefetch_out(true, true);
+ret+=Test(prefetch_out.Initnew("prefetch_test.bs", uncompressed, true, true), true, "prefetch file open");
+for(unsigned int i=0; i<20; i++){
+  std::vector<int> values(i+1, static_cast<int>(i));
+  prefetch_out.Set("values", values);
+  ret+=Test(prefetch_out.Save(i), true, "prefetch file save");
+}
+prefetch_out.Close();
+BStore prefetch_in(true, true);
+prefetch_in.SetPrefetch(4);
+ret+=Test(prefetch_in.Initnew("prefetch_test.bs", uncompressed, true, true), true, "prefetch file reopen");
+unsigned int order[]={0, 1, 2, 3, 4, 5, 6, 15, 16, 17, 3, 4, 19};
+for(size_t i=0; i<sizeof(order)/sizeof(order[0]); i++){
+  std::vector<int> values;
+  ret+=Test(prefetch_in.GetEntry(order[i]), true, "prefetch get entry");
+  ret+=Test(prefetch_in.Get("values", values), true, "prefetch get");
+  ret+=Test(values==std::vector<int>(order[i]+1, (int)order[i]), true, "prefetch value");
+}
+ret+=Test(prefetch_in.GetEntry(20), false, "prefetch get past the end");
+prefetch_in.Close();
+remove("prefetch_test.bs");
+
+// several threads reading one file through BStoreReaders
+for(int type=0; type<2; type++){
+  BStore shared(true, true);
+  ret+=Test(shared.Initnew("reader_test.bs", type ? block_compressed : uncompressed, true, true), true, "reader file open");
+  int run=3;
+  shared.Header->Set("run", run);
+  for(unsigned int i=0; i<50; i++){
+    std::vector<int> values(100, static_cast<int>(i));
+    shared.Set("values", values);
+    shared.Set("i", static_cast<int>(i));
+    ret+=Test(shared.Save(i), true, "reader file save");
+  }
+  BStoreReader reader;
+  ret+=Test(reader.Init(shared), true, "reader init");
+  ret+=Test(reader.NumEntries(), 50U, "reader entries");
+  int reader_run=0;
+  ret+=Test(reader.Header->Get("run", reader_run), true, "reader header");
+  ret+=Test(reader_run, 3, "reader header value");
+  std::vector<int> failures(4, 0);
+  std::vector<std::thread> threads;
+  for(int t=0; t<4; t++){
+    threads.push_back(std::thread([&reader, &failures, t](){
+      BStore entry(false, true);
+      for(int pass=0; pass<3; pass++){
+	for(unsigned int e=static_cast<unsigned int>(t); e<50; e+=4){
+	  std::vector<int> values;
+	  int i=-1;
+	  if(!reader.GetEntry(e, entry) || !entry.Get("values", values) || !entry.Get("i", i) || i!=static_cast<int>(e) || values!=std::vector<int>(100, i)) failures[static_cast<size_t>(t)]++;
+	}
+      }
+    }));
+  }
+  for(size_t t=0; t<threads.size(); t++) threads[t].join();
+  for(size_t t=0; t<failures.size(); t++) ret+=Test(failures[t], 0, "reader thread entries");
+  BStore entry(false, true);
+  ret+=Test(reader.GetEntry(50, entry), false, "reader entry past the end");
+  int i=50;
+  shared.Set("i", i);
+  ret+=Test(shared.Save(50), true, "reader file save after init");
+  ret+=Test(reader.Init(shared), true, "reader init again");
+  ret+=Test(reader.GetEntry(50, entry), true, "reader new entry");
+  ret+=Test(entry.Get("i", i), true, "reader new entry get");
+  ret+=Test(i, 50, "reader new entry value");
+  shared.Close();
+  remove("reader_test.bs");
+}
+
+// a journaled file that was never closed is recovered up to its last complete entry
+BStore journaled(true, true);
+journaled.SetJournal(true);
+ret+=Test(journaled.Initnew("journal_test.bs", uncompressed, true, true), true, "journaled file open");
+for(unsigned int i=0; i<3; i++){
+  std::vector<int> values(1000, static_cast<int>(i));
+  journaled.Set("values", values);
+  ret+=Test(journaled.Save(i), true, "journaled save");
+}
+// as the files would be left if the process died while the last entry was being written
+ret+=Test(CopyFile("journal_test.bs", "journal_crash.bs"), true, "copy journaled file");
+ret+=Test(CopyFile("journal_test.bs.journal", "journal_crash.bs.journal"), true, "copy journal");
+struct stat crash_stat;
+stat("journal_crash.bs", &crash_stat);
+ret+=Test(truncate("journal_crash.bs", crash_stat.st_size-100), 0, "truncate unclosed file");
+ret+=Test(journaled.Close(), true, "journaled file close");
+ret+=Test(stat("journal_test.bs.journal", &crash_stat), -1, "journal removed by close");
+BStore recovered(true, true);
+ret+=Test(recovered.Initnew("journal_crash.bs", uncompressed, true, true), true, "recover unclosed file");
+ret+=Test(recovered.NumEntries(), 2U, "recovered entries");
+std::vector<int> recovered_values;
+ret+=Test(recovered.GetEntry(1), true, "recovered get entry");
+ret+=Test(recovered.Get("values", recovered_values), true, "recovered get");
+ret+=Test(recovered_values==std::vector<int>(1000, 1), true, "recovered value");
+recovered_values.assign(1000, 2);
+recovered.Set("values", recovered_values);
+ret+=Test(recovered.Save(2), true, "save lost entry again");
+ret+=Test(recovered.Close(), true, "recovered file close");
+ret+=Test(stat("journal_crash.bs.journal", &crash_stat), -1, "recovered journal removed by close");
+BStore reopened(true, true);
+ret+=Test(reopened.Initnew("journal_crash.bs", uncompressed, true, true), true, "reopen recovered file");
+ret+=Test(reopened.NumEntries(), 3U, "reopened entries");
+ret+=Test(reopened.GetEntry(2), true, "reopened get entry");
+ret+=Test(reopened.Get("values", recovered_values), true, "reopened get");
+ret+=Test(recovered_values==std::vector<int>(1000, 2), true, "reopened value");
+reopened.Close();
+remove("journal_test.bs");
+remove("journal_crash.bs");
+
+// compaction drops overwritten entries, in the foreground and in the background
+for(int background=0; background<2; background++){
+  BStore compact(true, true);
+  ret+=Test(compact.Initnew("compact_test.bs", uncompressed, true, true), true, "compact file open");
+  for(unsigned int i=0; i<10; i++){
+    std::vector<int> values(500, static_cast<int>(i));
+    compact.Set("values", values);
+    ret+=Test(compact.Save(i), true, "compact file save");
+  }
+  for(unsigned int i=0; i<10; i+=2){
+    std::vector<int> values(500, -static_cast<int>(i));
+    compact.Set("values", values);
+    ret+=Test(compact.Save(i), true, "compact file overwrite");
+  }
+  ret+=Test(compact.Close(), true, "compact file close");
+  struct stat compact_stat;
+  stat("compact_test.bs", &compact_stat);
+  off_t before=compact_stat.st_size;
+  ret+=Test(compact.Initnew("compact_test.bs", uncompressed, true, true), true, "compact file reopen after close");
+  ret+=Test(compact.Compact("", background==1), true, "compact");
+  std::vector<int> values;
+  ret+=Test(compact.GetEntry(3), true, "get entry while compacting");
+  ret+=Test(compact.Get("values", values), true, "get while compacting");
+  ret+=Test(compact.CompactWait(), true, "compact wait");
+  stat("compact_test.bs", &compact_stat);
+  ret+=Test(compact_stat.st_size<before, true, "compacted file smaller");
+  ret+=Test(compact.NumEntries(), 10U, "compacted entries");
+  bool compacted_values=true;
+  for(unsigned int i=0; i<10; i++) compacted_values= compacted_values && compact.GetEntry(i) && compact.Get("values", values) && values==std::vector<int>(500, i%2 ? (int)i : -(int)i);
+  ret+=Test(compacted_values, true, "compacted values");
+  ret+=Test(compact.Compact("", true), true, "compact again");
+  ret+=Test(compact.Save(10), true, "save while compacting waits");
+  ret+=Test(compact.CompactWait(), false, "compaction refused after save");
+  remove("compact_test.bs.compact");
+  ret+=Test(compact.Close(), true, "compacted file close");
+  ret+=Test(compact.Close(), true, "close twice");
+  remove("compact_test.bs");
+}
+
+// batched saves are written together and read back as if saved one by one
+for(int type=0; type<2; type++){
+  BStore batched(true, true);
+  ret+=Test(batched.Initnew("batch_test.bs", type ? block_compressed : uncompressed, true, true), true, "batch file open");
+  batched.SetBatch(4, 2048);
+  for(unsigned int i=0; i<10; i++){
+    std::vector<int> values(i==7 ? 1000 : 10, static_cast<int>(i)); // entry 7 passes the byte limit
+    batched.Set("values", values);
+    ret+=Test(batched.Save(i), true, "batched save");
+  }
+  std::vector<int> batch_values;
+  ret+=Test(batched.GetEntry(9), true, "get batched entry before it is written");
+  ret+=Test(batched.Get("values", batch_values), true, "get batched value");
+  ret+=Test(batch_values==std::vector<int>(10, 9), true, "batched value");
+  batched.Set("values", batch_values);
+  ret+=Test(batched.Save(10), true, "batched save after get entry");
+  ret+=Test(batched.Close(), true, "batch file close");
+  BStore unbatched(true, true);
+  ret+=Test(unbatched.Initnew("batch_test.bs", type ? block_compressed : uncompressed, true, true), true, "batch file reopen");
+  ret+=Test(unbatched.NumEntries(), 11U, "batched entries");
+  bool batched_ok=true;
+  for(unsigned int i=0; i<11; i++) batched_ok= batched_ok && unbatched.GetEntry(i) && unbatched.Get("values", batch_values) && batch_values==std::vector<int>(i==7 ? 1000 : 10, i==10 ? 9 : (int)i);
+  ret+=Test(batched_ok, true, "batched values");
+  unbatched.Close();
+  remove("batch_test.bs");
+}
+
+// type checks compare the dictionary ids of the stored and requested types
+{
+  BStore typed(true, true);
+  ret+=Test(typed.Initnew("type_test.bs", uncompressed, true, true), true, "type file open");
+  typed.Set("value", 5);
+  int int_value=0;
+  double double_value=0;
+  ret+=Test(typed.Get("value", double_value), false, "get with wrong type");
+  ret+=Test(typed.Get("value", int_value), true, "get with right type");
+  typed.Set("value", 2.5);
+  ret+=Test(typed.Get("value", int_value), false, "get old type after type change");
+  ret+=Test(typed.Get("value", double_value) && double_value==2.5, true, "get new type after type change");
+  KeyHandle handle("value");
+  ret+=Test(typed.Get(handle, double_value), true, "get handle with right type");
+  typed.Set("value", 3);
+  ret+=Test(typed.Get(handle, double_value), false, "get handle after type change");
+  ret+=Test(typed.Get(handle, int_value) && int_value==3, true, "get handle with new type");
+  ret+=Test(typed.Save(0), true, "type file save");
+  typed.Set("value", std::string("text"));
+  ret+=Test(typed.Save(1), true, "type file save changed type");
+  ret+=Test(typed.Close(), true, "type file close");
+  BStore typed_in(true, true);
+  ret+=Test(typed_in.Initnew("type_test.bs", uncompressed, true, true), true, "type file reopen");
+  std::string string_value;
+  ret+=Test(typed_in.GetEntry(0) && typed_in.Get("value", int_value) && int_value==3, true, "reopened type");
+  ret+=Test(typed_in.Get("value", string_value), false, "reopened wrong type");
+  ret+=Test(typed_in.GetEntry(1) && typed_in.Get("value", string_value) && string_value=="text", true, "reopened changed type");
+  ret+=Test(typed_in.Get("value", int_value), false, "reopened old type");
+  typed_in.Close();
+  remove("type_test.bs");
+}
+
+// key handles look their key up again after it is removed or the entry changes
+{
+  BStore handled(true, true);
+  ret+=Test(handled.Initnew("handle_test.bs", uncompressed, true, true), true, "handle file open");
+  KeyHandle handle("value");
+  int value=0;
+  int first=1;
+  ret+=Test(handled.Set(handle, first), true, "set through handle");
+  ret+=Test(handled.Get(handle, value) && value==1, true, "get through handle");
+  handled.Remove("value");
+  ret+=Test(handled.Get(handle, value), false, "get through handle after remove");
+  handled.Set("value", 2);
+  ret+=Test(handled.Get(handle, value) && value==2, true, "get through handle after set by name");
+  handled.Delete();
+  ret+=Test(handled.Get(handle, value), false, "get through handle after delete");
+  int second=3;
+  ret+=Test(handled.Set(handle, second), true, "set through handle after delete");
+  ret+=Test(handled.Save(0), true, "handle file save");
+  handled.Set("value", 4);
+  ret+=Test(handled.Save(1), true, "handle file save second entry");
+  ret+=Test(handled.GetEntry(0) && handled.Get(handle, value) && value==3, true, "get through handle after get entry");
+  ret+=Test(handled.GetEntry(1) && handled.Get(handle, value) && value==4, true, "get through handle after next get entry");
+  BStore other(true, true);
+  other.Set("value", 5);
+  ret+=Test(other.Get(handle, value) && value==5, true, "get through handle from another store");
+  ret+=Test(handled.Get(handle, value) && value==4, true, "get through handle back on first store");
+  handled.Close();
+  remove("handle_test.bs");
+}
+
+// moved, emplaced and self referencing sets in memory mode
+{
+  BStore moved_store(false, true);
+  moved_store.SetInMemory(true);
+  std::string text(1000, 'a');
+  ret+=Test(moved_store.Set("text", std::move(text)), true, "set moved string");
+  std::string* text_ptr=0;
+  ret+=Test(moved_store.Get("text", text_ptr) && *text_ptr==std::string(1000, 'a'), true, "get moved string");
+  ret+=Test(moved_store.Set("text", *text_ptr), true, "set string to itself");
+  ret+=Test(moved_store.Get("text", text_ptr) && *text_ptr==std::string(1000, 'a'), true, "string set to itself");
+  ret+=Test(moved_store.Set("text", std::move(*text_ptr)), true, "set string to itself moved");
+  ret+=Test(moved_store.Get("text", text_ptr) && *text_ptr==std::string(1000, 'a'), true, "string set to itself moved");
+  ret+=Test(moved_store.Emplace<std::string>("text", text_ptr->begin(), text_ptr->begin()+10), true, "emplace from own value");
+  std::string emplaced;
+  ret+=Test(moved_store.Get("text", emplaced), true, "get emplaced string");
+  ret+=Test(emplaced, std::string(10, 'a'), "emplaced string");
+  std::vector<int> values(100, 3);
+  ret+=Test(moved_store.Set("values", values), true, "set vector");
+  std::vector<int>* values_ptr=0;
+  ret+=Test(moved_store.Get("values", values_ptr), true, "get vector pointer");
+  ret+=Test(moved_store.Set("values", std::move(*values_ptr)), true, "set vector to itself moved");
+  ret+=Test(moved_store.Get("values", values) && values==std::vector<int>(100, 3), true, "vector set to itself moved");
+  ret+=Test(moved_store.Get("values", values_ptr) && moved_store.Emplace<std::vector<int> >("values", values_ptr->begin(), values_ptr->begin()+5), true, "emplace vector from own value");
+  ret+=Test(moved_store.Get("values", values) && values==std::vector<int>(5, 3), true, "vector emplaced from own value");
+  moved_store.SetInMemory(false);
+  ret+=Test(moved_store.Emplace<std::string>("serialised", std::string::size_type(5), 'b'), true, "emplace serialised");
+  ret+=Test(moved_store.Get("serialised", emplaced) && emplaced=="bbbbb", true, "get emplaced serialised");
+}
+
+// entries pass between processes through a shared memory ring, which is removed once both sides close
+{
+  pid_t writer_pid=fork();
+  if(writer_pid==0){
+    BStore writer(true, true);
+    writer.SetRing(2, 4096);
+    writer.SetRingTimeout(10000);
+    int failed= !writer.Initnew("bstore_ring_test", shared_memory, true, true);
+    writer.Header->Set("run", 7);
+    for(unsigned int i=0; i<20 && !failed; i++){
+      std::vector<int> values(10, static_cast<int>(i));
+      writer.Set("values", values);
+      failed= !writer.Save(i);
+    }
+    failed= !writer.Close() || failed;
+    _exit(failed);
+  }
+  BStore reader(true, true);
+  reader.SetRingTimeout(10000);
+  ret+=Test(reader.Initnew("bstore_ring_test", shared_memory, true, true), true, "ring attach");
+  bool ring_ok=true;
+  std::vector<int> ring_values;
+  for(unsigned int i=0; i<20; i++) ring_ok= ring_ok && reader.GetEntry(i) && reader.Get("values", ring_values) && ring_values==std::vector<int>(10, static_cast<int>(i));
+  ret+=Test(ring_ok, true, "ring entries");
+  int run=0;
+  ret+=Test(reader.Header->Get("run", run) && run==7, true, "ring header");
+  ret+=Test(reader.GetEntry(20), false, "ring entry after writer closed");
+  ret+=Test(reader.Close(), true, "ring reader close");
+  int status=-1;
+  waitpid(writer_pid, &status, 0);
+  ret+=Test(WIFEXITED(status) && WEXITSTATUS(status)==0, true, "ring writer");
+  int fd=shm_open("/bstore_ring_test", O_RDONLY, 0);
+  ret+=Test(fd, -1, "ring removed");
+  if(fd!=-1) close(fd);
+  
+  BStore unread(true, true);
+  unread.SetRing(2, 4096);
+  ret+=Test(unread.Initnew("bstore_ring_test", shared_memory, true, true), true, "ring without reader");
+  unread.Set("values", ring_values);
+  ret+=Test(unread.Save(0), true, "ring save without reader");
+  ret+=Test(unread.Close(), true, "ring close without reader");
+  fd=shm_open("/bstore_ring_test", O_RDONLY, 0);
+  ret+=Test(fd, -1, "ring removed without reader");
+  if(fd!=-1) close(fd);
+}
+
+// secondary indexes find entries by value without reading them
+{
+  BStore indexed(true, true);
+  ret+=Test(indexed.Initnew("index_test.bs", uncompressed, true, true), true, "index file open");
+  for(unsigned int i=0; i<10; i++){
+    indexed.Set("energy", static_cast<int>(i)-5);
+    indexed.Set("pt", i*0.5);
+    if(i%3==0) indexed.Set("flag", static_cast<int>(i));
+    ret+=Test(indexed.Save(i), true, "index file save");
+    indexed.Delete();
+  }
+  int energy=0;
+  ret+=Test(indexed.GetEntry(7) && indexed.Get("energy", energy) && energy==2, true, "get entry before index");
+  ret+=Test(indexed.AddIndex<int>("energy"), true, "index existing entries");
+  ret+=Test(indexed.Get("energy", energy) && energy==2, true, "entry kept after index");
+  ret+=Test(indexed.AddIndex<double>("pt"), true, "index second key");
+  ret+=Test(indexed.AddIndex<double>("energy"), false, "index with other type");
+  std::vector<unsigned int> found;
+  ret+=Test(indexed.Query("energy", -2, 1, found), true, "query range");
+  ret+=Test(found==std::vector<unsigned int>({3, 4, 5, 6}), true, "query range entries");
+  ret+=Test(indexed.Query("energy", -5, found) && found==std::vector<unsigned int>({0}), true, "query negative value");
+  ret+=Test(indexed.Query("pt", 3.0, 10.0, found) && found==std::vector<unsigned int>({6, 7, 8, 9}), true, "query double range");
+  ret+=Test(indexed.Query("energy", 2.0, 3.0, found), false, "query with other type");
+  ret+=Test(indexed.Query("flag", 0, 10, found), false, "query unindexed key");
+  indexed.Delete();
+  indexed.Set("energy", -100);
+  ret+=Test(indexed.Save(10), true, "save indexed entry");
+  ret+=Test(indexed.Query("energy", -1000, -5, found) && found==std::vector<unsigned int>({0, 10}), true, "query saved entry");
+  ret+=Test(indexed.DeleteEntry(0), true, "delete indexed entry");
+  ret+=Test(indexed.Query("energy", -1000, -5, found) && found==std::vector<unsigned int>({9}), true, "query after delete"); // later entries move down
+  ret+=Test(indexed.Close(), true, "index file close");
+  BStore reindexed(true, true);
+  ret+=Test(reindexed.Initnew("index_test.bs", uncompressed, true, true), true, "index file reopen");
+  ret+=Test(reindexed.HasIndex("energy") && reindexed.HasIndex("pt"), true, "index restored");
+  ret+=Test(reindexed.Query("energy", 0, 1000, found) && found==std::vector<unsigned int>({4, 5, 6, 7, 8}), true, "query restored index");
+  reindexed.Close();
+  remove("index_test.bs");
+}
+
+return ret;
+
+}
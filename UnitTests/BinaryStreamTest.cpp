@@ -0,0 +1,210 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <BinaryStream.h>
+#include <Codec.h>
+
+using namespace ToolFramework;
+
+int test_counter=0;
+
+template <typename T> int Test(T a, T b, std::string message=""){
+test_counter++;
+
+if(a!=b){
+    std::cout<<"ERROR "<<test_counter<<" "<<message<<": "<<a<<"!="<<b<<std::endl;
+    return test_counter;
+}
+return 0;
+
+}
+
+
+int main(){
+
+int ret=0;
+
+BinaryStream bs;
+bs.Reserve(64);
+size_t capacity=bs.buffer.capacity();
+
+int a=1;
+int b=2;
+int c=3;
+int d=42;
+
+bs << a;
+bs << b;
+bs << c;
+
+// overwrite in place after a seek
+bs.Bseek(sizeof(int),SEEK_SET);
+bs << d;
+ret+=Test(bs.Size(), 3*sizeof(int), "overwrite changed size");
+ret+=Test(bs.Btell(), (unsigned long)(2*sizeof(int)), "overwrite position");
+
+int a2=0;
+int b2=0;
+int c2=0;
+bs.Bseek(0,SEEK_SET);
+bs >> a2;
+bs >> b2;
+bs >> c2;
+ret+=Test(a,a2);
+ret+=Test(d,b2);
+ret+=Test(c,c2);
+ret+=Test(bs >> a2, false, "read past end");
+
+bs.Reset();
+ret+=Test(bs.Size(), (size_t)0, "reset size");
+ret+=Test(bs.buffer.capacity()>=capacity, true, "reset kept capacity");
+
+std::string h="hello world";
+std::vector<float> v(100,4.4);
+bs << v;
+bs << h;
+bs.Bseek(0,SEEK_SET);
+
+BinaryView<char> h2;
+BinaryView<float> v2;
+bs >> v2;
+bs >> h2;
+ret+=Test(std::string(h2.begin(),h2.end()), h, "string view");
+ret+=Test(v2.size(), v.size(), "vector view size");
+ret+=Test(v2[99], v[99], "vector view value");
+ret+=Test(v2.Borrowed(), true, "vector view borrowed");
+
+// lengths past 32 bits are escaped, shorter ones keep the old 4 byte form
+bs.Reset();
+uint64_t l=5000000000ULL;
+uint64_t l2=0;
+uint64_t s=7;
+uint64_t s2=0;
+bs.WriteSize(l);
+bs.WriteSize(s);
+ret+=Test(bs.Size(), (size_t)16, "size escape length");
+bs.Bseek(0,SEEK_SET);
+bs.ReadSize(l2);
+bs.ReadSize(s2);
+ret+=Test(l,l2, "long size");
+ret+=Test(s,s2, "short size");
+
+// block compressed frames, small so values straddle frame boundaries
+BinaryStream block(BLOCK_COMPRESSED);
+block.m_block_size=64;
+block.m_codec=FAST_CODEC;
+ret+=Test(block.Bopen("block_test.bsf", NEW_READ, BLOCK_COMPRESSED), true, "block open");
+std::vector<int> values(100);
+for(size_t i=0; i<values.size(); i++) values[i]=(int)i;
+for(size_t i=0; i<values.size(); i++) block << values[i];
+block << h;
+ret+=Test(block.Bseek(0, SEEK_SET), true, "block seek before close");
+int first=-1;
+block >> first;
+ret+=Test(first, 0, "block read back before close");
+ret+=Test(block.Bwrite(&first, sizeof(first)), false, "block write not at end");
+ret+=Test(block.Bseek(0, SEEK_END), true, "block seek to end");
+ret+=Test(block.Bwrite(&first, sizeof(first)), true, "block append");
+ret+=Test(block.Bclose(), true, "block close");
+
+ret+=Test(block.Bopen("block_test.bsf", READ, BLOCK_COMPRESSED), true, "block reopen");
+bool read_all=true;
+for(size_t i=0; i<values.size(); i++){
+  int value=-1;
+  read_all= read_all && (block >> value) && value==values[i];
+}
+ret+=Test(read_all, true, "block read across frames");
+std::string h3;
+block >> h3;
+ret+=Test(h3, h, "block string");
+int straddle=-1;
+ret+=Test(block.Bseek(15*sizeof(int), SEEK_SET), true, "block seek into frame");
+block >> straddle;
+ret+=Test(straddle, 15, "block value at frame boundary");
+ret+=Test(block.Bseek(62, SEEK_SET), true, "block seek inside value");
+uint32_t split=0;
+block.Bread(&split, sizeof(split));
+uint32_t expected=0;
+memcpy(&expected, reinterpret_cast<const char*>(values.data())+62, sizeof(expected));
+ret+=Test(split, expected, "block read split over two frames");
+int pread_value=-1;
+ret+=Test(block.Bpread(&pread_value, sizeof(pread_value), 40*sizeof(int)), (unsigned long)sizeof(int), "block pread length");
+ret+=Test(pread_value, 40, "block pread value");
+ret+=Test(block.Bpread(&pread_value, sizeof(pread_value), 41*sizeof(int)), (unsigned long)sizeof(int), "block pread from cached frame");
+ret+=Test(pread_value, 41, "block pread cached value");
+ret+=Test(block.Bwrite(&first, sizeof(first)), false, "block write when read only");
+block.Bclose();
+ret+=Test(block.Bopen("block_test.bsf", NEW_READ, BLOCK_COMPRESSED), true, "block rewrite");
+for(size_t i=0; i<values.size(); i++){
+  int negative=-values[i];
+  block << negative;
+}
+block.Bclose();
+ret+=Test(block.Bopen("block_test.bsf", READ, BLOCK_COMPRESSED), true, "block reopen rewritten");
+ret+=Test(block.Bpread(&pread_value, sizeof(pread_value), 40*sizeof(int)), (unsigned long)sizeof(int), "block pread rewritten");
+ret+=Test(pread_value, -40, "block pread doesnt use frames of the old file");
+block.Bclose();
+remove("block_test.bsf");
+
+// codecs round trip repetitive, random and empty blocks and reject corrupt ones
+std::string plain;
+for(int i=0; i<5000; i++) plain+="event "+std::to_string(i%37)+" ";
+for(int i=0; i<5000; i++) plain+=(char)((i*7919)%251);
+std::vector<enum_codec> codecs;
+codecs.push_back(FAST_CODEC);
+#ifdef ZLIB
+codecs.push_back(ZLIB_CODEC);
+#endif
+for(size_t i=0; i<codecs.size(); i++){
+  Codec* codec=Codec::Get(codecs[i]);
+  std::string compressed;
+  std::string decompressed(plain.length(), 0);
+  ret+=Test(codec!=0, true, "codec available");
+  ret+=Test(codec->Compress(plain.data(), plain.length(), compressed), true, codec->Name()+" compress");
+  ret+=Test(compressed.length()<plain.length(), true, codec->Name()+" compresses");
+  ret+=Test(codec->Decompress(compressed.data(), compressed.length(), &decompressed[0], decompressed.length()), true, codec->Name()+" decompress");
+  ret+=Test(decompressed, plain, codec->Name()+" round trip");
+  ret+=Test(codec->Decompress(compressed.data(), compressed.length(), &decompressed[0], decompressed.length()-1), false, codec->Name()+" wrong size");
+  ret+=Test(codec->Decompress(compressed.data(), compressed.length()/2, &decompressed[0], decompressed.length()), false, codec->Name()+" truncated");
+  std::string empty;
+  ret+=Test(codec->Compress(plain.data(), 0, compressed), true, codec->Name()+" compress empty");
+  ret+=Test(codec->Decompress(compressed.data(), compressed.length(), &empty[0], 0), true, codec->Name()+" decompress empty");
+}
+
+// blocks compressed on several threads come back in order, the same pool serving each batch
+CompressionPool compressors(4);
+for(size_t i=0; i<codecs.size(); i++){
+  std::vector<std::string> blocks;
+  unsigned long int block_size=1000;
+  ret+=Test(Codec::CompressBlocks(codecs[i], -1, plain.data(), plain.length(), block_size, blocks, &compressors), true, "compress blocks");
+  ret+=Test(blocks.size(), (plain.length()+block_size-1)/block_size, "number of blocks");
+  std::string joined;
+  for(size_t j=0; j<blocks.size(); j++){
+    std::string part(j+1<blocks.size() ? block_size : plain.length()-j*block_size, 0);
+    Codec::Get(codecs[i])->Decompress(blocks[j].data(), blocks[j].length(), &part[0], part.length());
+    joined+=part;
+  }
+  ret+=Test(joined, plain, "threaded blocks round trip");
+}
+
+#ifdef ZLIB
+// post_pre_compress files closed with several threads are concatenated zlib streams
+BinaryStream multi;
+multi.m_compression_threads=2;
+std::vector<int> large(900000);
+for(size_t i=0; i<large.size(); i++) large[i]=(int)(i%1000);
+ret+=Test(multi.Bopen("pdef_test.gz", NEW, POST_PRE_COMPRESS), true, "multi stream open");
+multi << large;
+ret+=Test(multi.Bclose(), true, "multi stream close");
+BinaryStream multi_read;
+std::vector<int> large2;
+ret+=Test(multi_read.Bopen("pdef_test.gz", READ, POST_PRE_COMPRESS), true, "multi stream reopen");
+multi_read >> large2;
+ret+=Test(large2==large, true, "multi stream round trip");
+multi_read.Bclose();
+remove("pdef_test.gz");
+#endif
+
+return ret;
+
+}
@@ -0,0 +1,344 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <JobQueue.h>
+#include <WorkerPoolManager.h>
+#include <Buffer.h>
+
+using namespace ToolFramework;
+
+int test_counter=0;
+
+template <typename T> int Test(T a, T b, std::string message=""){
+test_counter++;
+
+if(a!=b){
+    std::cout<<"ERROR "<<test_counter<<" "<<message<<": "<<a<<"!="<<b<<std::endl;
+    return test_counter;
+}
+return 0;
+
+}
+
+const unsigned int num_children=1000;
+std::atomic<int> runs[num_children];
+std::atomic<unsigned int> done(0);
+JobQueue* stealing_queue=0;
+
+static bool Child(void*& data){
+  reinterpret_cast<std::atomic<int>*>(data)->fetch_add(1);
+  done++;
+  return true;
+}
+
+static bool Parent(void*& data){ // adds its children to this worker's local deque then stays busy so only other workers can run them
+  for(unsigned int i=0; i<num_children; i++){
+    Job* child=new Job("child");
+    child->func=Child;
+    child->data=&runs[i];
+    if(!stealing_queue->AddJob(child)) return false;
+  }
+  std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+  while(done.load()<num_children && std::chrono::steady_clock::now()-start<std::chrono::seconds(10)) std::this_thread::yield();
+  return done.load()==num_children;
+}
+
+std::atomic<unsigned int> ran(0);
+std::atomic<unsigned int> failed(0);
+
+static bool Count(void*& data){
+  ran++;
+  return true;
+}
+
+static void CountFailed(void*& data){
+  failed++;
+}
+
+std::atomic<unsigned int> sequence(0);
+
+static bool Record(void*& data){ // stores the order the job ran in
+  *reinterpret_cast<unsigned int*>(data)=++sequence;
+  return true;
+}
+
+static bool Fail(void*& data){
+  return false;
+}
+
+static Job* NewJob(std::string id, unsigned int* order, bool (*func)(void*&)=Record){
+  Job* job=new Job(id);
+  job->func=func;
+  job->fail_func=CountFailed;
+  job->data=order;
+  return job;
+}
+
+static void LongSleep(Thread_args* args){
+  args->Sleep(10000000);
+}
+
+template <typename T> bool WaitFor(T condition){
+  std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+  while(!condition() && std::chrono::steady_clock::now()-start<std::chrono::seconds(10)) usleep(100);
+  return condition();
+}
+
+
+int main(){
+
+int ret=0;
+
+// jobs added by a worker are stolen from its local deque by the others and each runs exactly once
+{
+  for(unsigned int i=0; i<num_children; i++) runs[i]=0;
+  JobQueue queue;
+  stealing_queue=&queue;
+  unsigned int thread_cap=4;
+  WorkerPoolManager pool(queue, &thread_cap, 0, 0, 0, true, true, 100, 10000, 1000, true);
+  Job* parent=new Job("parent");
+  parent->func=Parent;
+  ret+=Test(queue.AddJob(parent), true, "add parent job");
+  ret+=Test(WaitFor([](){ return done.load()==num_children; }), true, "stolen jobs finished");
+  unsigned int once=0;
+  for(unsigned int i=0; i<num_children; i++) once+= runs[i].load()==1;
+  ret+=Test(once, num_children, "stolen jobs run once");
+  ret+=Test(WaitFor([&queue](){ return queue.size()==0; }), true, "queue drained");
+  usleep(10000);
+  unsigned int extra=0;
+  for(unsigned int i=0; i<num_children; i++) extra+= runs[i].load()!=1;
+  ret+=Test(extra, 0U, "stolen jobs not rerun");
+}
+
+// higher priority jobs are taken first, equal priorities in the order they were added
+for(unsigned int capacity=0; capacity<=8; capacity+=8){
+  JobQueue queue(capacity);
+  unsigned int priorities[]={0, 2, 1, 0, 2, 1, 0};
+  std::string order="";
+  for(unsigned int i=0; i<7; i++){
+    Job* job=new Job(std::to_string(i));
+    job->func=Count;
+    job->priority=priorities[i];
+    ret+=Test(queue.AddJob(job), true, "add prioritised job");
+  }
+  ret+=Test(queue.size(), 7U, "prioritised jobs queued");
+  for(Job* job=queue.GetJob(); job; job=queue.GetJob()){
+    order+=job->m_id;
+    delete job;
+  }
+  ret+=Test(order, std::string("1425036"), "priority order");
+  ret+=Test(queue.size(), 0U, "prioritised jobs taken");
+}
+
+// jobs past their deadline are failed without running and counted as expired
+{
+  ran=0;
+  failed=0;
+  JobQueue queue;
+  unsigned int thread_cap=2;
+  WorkerPoolManager pool(queue, &thread_cap, 0, 0, 0, true, true, 100, 10000, 1000);
+  for(unsigned int i=0; i<10; i++){
+    Job* job=new Job(i%2 ? "late" : "ontime");
+    job->func=Count;
+    job->fail_func=CountFailed;
+    job->deadline=std::chrono::steady_clock::now()+(i%2 ? std::chrono::seconds(-1) : std::chrono::seconds(60));
+    ret+=Test(queue.AddJob(job), true, "add job with deadline");
+  }
+  Store stats;
+  unsigned long late_expired=0, late_failed=0, ontime_completed=0, ontime_expired=0;
+  ret+=Test(WaitFor([&](){ pool.GetStats(stats); return stats.Get("ontime_completed", ontime_completed) && ontime_completed==5 && stats.Get("late_failed", late_failed) && late_failed==5 && failed.load()==5; }), true, "jobs with deadlines finished");
+  ret+=Test(ran.load(), 5U, "only jobs within their deadline run");
+  ret+=Test(stats.Get("late_expired", late_expired) && late_expired==5, true, "expired jobs counted");
+  ret+=Test(stats.Get("ontime_expired", ontime_expired) && ontime_expired==0, true, "jobs within their deadline not expired");
+  Job unqueued("unqueued");
+  ret+=Test(unqueued.Expired(), false, "no deadline never expires");
+}
+
+// jobs declared to run After or Then others wait for them, and fail without running if they fail
+{
+  sequence=0;
+  failed=0;
+  JobQueue queue;
+  JobDeque finished;
+  unsigned int thread_cap=4;
+  WorkerPoolManager pool(queue, &thread_cap, 0, 0, 0, true, true, 100, 10000, 1000);
+  unsigned int order[8]={0, 0, 0, 0, 0, 0, 0, 0};
+  Job* first=NewJob("first", &order[0]);
+  Job* second=NewJob("second", &order[1]);
+  Job* third=NewJob("third", &order[2]);
+  ret+=Test(first->Then(second)->Then(third)==third, true, "then chains");
+  Job* joined=NewJob("joined", &order[3]);
+  joined->After(first);
+  joined->After(third);
+  ret+=Test(queue.AddJob(joined) && queue.AddJob(third) && queue.AddJob(second), true, "add waiting jobs");
+  usleep(10000);
+  ret+=Test(sequence.load(), 0U, "jobs wait for predecessors");
+  ret+=Test(queue.AddJob(first), true, "add first job");
+  ret+=Test(WaitFor([&order](){ return order[3]!=0; }), true, "dependent jobs run");
+  ret+=Test(order[0]<order[1] && order[1]<order[2] && order[2]<order[3], true, "dependent jobs run in order");
+
+  Job* failing=NewJob("failing", &order[4], Fail);
+  Job* after_failed=NewJob("after_failed", &order[5]);
+  Job* after_that=NewJob("after_that", &order[6]);
+  failing->Then(after_failed)->Then(after_that);
+  after_that->out_deque=&finished;
+  ret+=Test(queue.AddJob(after_that) && queue.AddJob(after_failed) && queue.AddJob(failing), true, "add jobs after failing one");
+  ret+=Test(WaitFor([&finished](){ return finished.size()==1; }), true, "jobs after failed one finish");
+  Job* chain_end=finished.GetJob("after_that");
+  ret+=Test(chain_end!=0 && chain_end->m_failed, true, "jobs after failed one fail");
+  ret+=Test(order[5]==0 && order[6]==0, true, "jobs after failed one dont run");
+  ret+=Test(failed.load(), 3U, "fail_func called for failed chain");
+
+  Job* late=NewJob("late", &order[7]);
+  late->After(chain_end); // chain_end has already finished
+  ret+=Test(queue.AddJob(late), true, "add job after finished predecessor");
+  ret+=Test(WaitFor([](){ return failed.load()==4; }), true, "job after finished failed predecessor fails");
+  ret+=Test(order[7], 0U, "job after finished failed predecessor doesnt run");
+  delete chain_end;
+}
+
+// jobs still waiting when their queue is destroyed are deleted once their predecessors finish rather than queued
+{
+  JobQueue* queue=new JobQueue();
+  unsigned int order=0;
+  Job* predecessor=NewJob("predecessor", &order);
+  Job* waiting=NewJob("waiting", &order);
+  waiting->After(predecessor);
+  ret+=Test(queue->AddJob(waiting), true, "add job to queue that will be destroyed");
+  ret+=Test(queue->size(), 0U, "waiting job not queued");
+  delete queue;
+  predecessor->ReleaseDependents();
+  ret+=Test(order, 0U, "orphaned job not run");
+  delete predecessor;
+}
+
+// the lock free ring refuses jobs once full and keeps them in order as its indices wrap
+{
+  JobQueue ring(4);
+  ret+=Test(ring.capacity(), 4U, "ring capacity");
+  Job* jobs[4];
+  bool added=true;
+  for(unsigned int i=0; i<4; i++){
+    jobs[i]=NewJob("ring", 0, Count);
+    added= ring.AddJob(jobs[i]) && added;
+  }
+  ret+=Test(added, true, "fill ring");
+  Job* extra=NewJob("ring", 0, Count);
+  ret+=Test(ring.AddJob(extra), false, "add to full ring");
+  delete extra;
+  bool in_order=true;
+  for(unsigned int i=0; i<4; i++){
+    Job* job=ring.GetJob();
+    in_order= in_order && job==jobs[i];
+    delete job;
+  }
+  ret+=Test(in_order, true, "full ring order");
+  ret+=Test(ring.GetJob()==0, true, "emptied ring");
+
+  // 100 batches of 3 take the indices round the 4 slots 75 times
+  bool wrapped=true;
+  for(unsigned int pass=0; pass<100; pass++){
+    Job* batch[3];
+    for(unsigned int i=0; i<3; i++){
+      batch[i]=NewJob("ring", 0, Count);
+      wrapped= ring.AddJob(batch[i]) && wrapped;
+    }
+    for(unsigned int i=0; i<3; i++){
+      Job* job=ring.GetJob();
+      wrapped= wrapped && job==batch[i];
+      delete job;
+    }
+  }
+  ret+=Test(wrapped, true, "ring order after wrapping");
+  ret+=Test(ring.size(), 0U, "ring empty after wrapping");
+}
+
+// several producers and consumers sharing a ring neither lose nor repeat jobs
+{
+  const unsigned int producers=4;
+  const unsigned int consumers=4;
+  const unsigned int per_producer=20000;
+  const unsigned int total=producers*per_producer;
+  JobQueue ring(64);
+  std::vector<std::atomic<unsigned int> > taken(total);
+  std::atomic<unsigned int> num_taken(0);
+  std::vector<std::thread> threads;
+  for(unsigned int p=0; p<producers; p++){
+    threads.push_back(std::thread([&ring, &taken, p, per_producer](){
+      for(unsigned int i=p*per_producer; i<(p+1)*per_producer; i++){
+	Job* job=NewJob("ring", 0, Count);
+	job->data=&taken[i];
+	while(!ring.AddJob(job)) std::this_thread::yield(); // full, wait for the consumers
+      }
+    }));
+  }
+  for(unsigned int c=0; c<consumers; c++){
+    threads.push_back(std::thread([&ring, &num_taken, total](){
+      std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+      while(num_taken.load()<total && std::chrono::steady_clock::now()-start<std::chrono::seconds(10)){
+	Job* job=ring.GetJob();
+	if(job==0){
+	  std::this_thread::yield();
+	  continue;
+	}
+	reinterpret_cast<std::atomic<unsigned int>*>(job->data)->fetch_add(1);
+	num_taken++;
+	delete job;
+      }
+    }));
+  }
+  for(size_t i=0; i<threads.size(); i++) threads[i].join();
+  ret+=Test(num_taken.load(), total, "ring jobs taken");
+  unsigned int once=0;
+  for(unsigned int i=0; i<total; i++) if(taken[i].load()==1) once++;
+  ret+=Test(once, total, "ring jobs taken exactly once");
+  ret+=Test(ring.size(), 0U, "ring empty");
+}
+
+// sleeping threads are woken as soon as there is work for them or they are killed, long before their timeout
+{
+  ran=0;
+  std::chrono::steady_clock::time_point stopping;
+  {
+    JobQueue queue;
+    unsigned int thread_cap=1;
+    WorkerPoolManager pool(queue, &thread_cap, 0, 0, 0, true, true, 5000000, 10000, 1000); // idle workers wait up to 5s for jobs
+    ret+=Test(queue.AddJob(NewJob("wake", 0, Count)), true, "add job to start worker");
+    ret+=Test(WaitFor([](){ return ran.load()==1; }), true, "worker started");
+    usleep(100000); // back asleep in JobQueue::Wait
+    std::chrono::steady_clock::time_point added=std::chrono::steady_clock::now();
+    ret+=Test(queue.AddJob(NewJob("wake", 0, Count)), true, "add job for sleeping worker");
+    ret+=Test(WaitFor([](){ return ran.load()==2; }), true, "sleeping worker runs job");
+    ret+=Test(std::chrono::steady_clock::now()-added<std::chrono::seconds(1), true, "sleeping worker woken by job");
+    usleep(100000);
+    stopping=std::chrono::steady_clock::now();
+  }
+  ret+=Test(std::chrono::steady_clock::now()-stopping<std::chrono::seconds(1), true, "sleeping workers stopped promptly");
+
+  Utilities utilities;
+  Thread_args sleeper_args;
+  Thread_args* sleeper=utilities.CreateThread("sleeper", LongSleep, &sleeper_args);
+  ret+=Test(sleeper==&sleeper_args, true, "create sleeping thread");
+  usleep(100000);
+  std::chrono::steady_clock::time_point killing=std::chrono::steady_clock::now();
+  utilities.KillThread(sleeper);
+  ret+=Test(std::chrono::steady_clock::now()-killing<std::chrono::seconds(1), true, "sleeping thread killed promptly");
+
+  Buffer<int> buffer;
+  Thread_args waiter;
+  std::thread adder([&buffer](){
+    usleep(100000);
+    int value=1;
+    buffer.Add(value);
+  });
+  std::chrono::steady_clock::time_point waiting=std::chrono::steady_clock::now();
+  ret+=Test(buffer.Wait(&waiter, 5000000), true, "buffer wait woken by data");
+  ret+=Test(std::chrono::steady_clock::now()-waiting<std::chrono::seconds(1), true, "buffer wait woken promptly");
+  adder.join();
+}
+
+return ret;
+
+}
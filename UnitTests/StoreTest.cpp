@@ -101,6 +101,22 @@ ret+=Test(b,l2);
 ret+=Test(d,m2);
 ret+=Test(f,n2);
 
+std::string moved="moved value";
+store.Set("o", std::move(moved));
+std::string o2, o_expected="moved value";
+pass=store.Get("o", o2);
+ret+=Test(pass, tmp, "Get moved string");
+ret+=Test(o2, o_expected, "moved string");
+
+std::string copy=*store["o"];
+store.Set("p", copy);
+store.Set("o", *store["o"]); // set to its own value
+ret+=Test(*store["o"], *store["p"], "self set");
+copy=*store["o"];
+store.Set("p", std::move(copy));
+store.Set("o", std::move(*store["o"]));
+ret+=Test(*store["o"], *store["p"], "self set moved");
+
 store.Print();
 
 
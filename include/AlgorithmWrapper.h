@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/AlgorithmWrapper.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/BStore.h
\ No newline at end of file
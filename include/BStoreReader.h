@@ -0,0 +1 @@
+/root/repo/src/Store/BStoreReader.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/BinaryStream.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/Buffer.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/BufferDispatcher.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/Codec.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/DataModelBase.h
\ No newline at end of file
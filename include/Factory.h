@@ -0,0 +1 @@
+/root/repo/src/Factory/Factory.h
\ No newline at end of file
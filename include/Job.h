@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/Job.h
\ No newline at end of file
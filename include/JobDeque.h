@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/JobDeque.h
\ No newline at end of file
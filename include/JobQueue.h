@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/JobQueue.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/Json.h
\ No newline at end of file
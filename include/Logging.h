@@ -0,0 +1 @@
+/root/repo/src/Logging/Logging.h
\ No newline at end of file
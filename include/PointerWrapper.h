@@ -0,0 +1 @@
+/root/repo/src/Store/PointerWrapper.h
\ No newline at end of file
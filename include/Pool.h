@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/Pool.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/SerialisableObject.h
\ No newline at end of file
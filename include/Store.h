@@ -0,0 +1 @@
+/root/repo/src/Store/Store.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Store/TaggedSerialisableObject.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/src/Tool/Tool.h
\ No newline at end of file
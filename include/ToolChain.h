@@ -0,0 +1 @@
+/root/repo/src/ToolChain/ToolChain.h
\ No newline at end of file
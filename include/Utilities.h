@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/Utilities.h
\ No newline at end of file
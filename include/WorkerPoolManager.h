@@ -0,0 +1 @@
+/root/repo/src/DataModelBase/WorkerPoolManager.h
\ No newline at end of file
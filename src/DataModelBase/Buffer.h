@@ -5,6 +5,7 @@
 #include <mutex>
 #include <SerialisableObject.h>
 #include <BinaryStream.h>
+#include <Utilities.h>
 
 namespace ToolFramework{
   
@@ -12,11 +13,26 @@ namespace ToolFramework{
     
   public:
     
-    Buffer(){;}
+    Buffer(){ waiter = 0; }
     void Add(T &in){
       std::lock_guard<std::mutex> lock(mtx);    
       data.push_back(in);
+      if(waiter){
+	waiter->Wake();
+	waiter = 0;
+      }
     };
+    bool Wait(Thread_args* args, unsigned int timeout_us){ ///< Sleep the calling thread until data is added, it is woken or the timeout passes. Only one thread can wait at a time. Returns true if there is data
+      {
+	std::lock_guard<std::mutex> lock(mtx);
+	if(data.size()) return true;
+	waiter = args;
+      }
+      args->Sleep(timeout_us);
+      std::lock_guard<std::mutex> lock(mtx);
+      if(waiter == args) waiter = 0;
+      return data.size() > 0;
+    }
     void Swap(std::vector<T> &in){
       std::lock_guard<std::mutex> lock(mtx);
       if(data.size()) std::swap (data, in);
@@ -51,6 +67,7 @@ namespace ToolFramework{
   private:
     std::vector<T> data;
     std::mutex mtx;
+    Thread_args* waiter;
     
   };
   
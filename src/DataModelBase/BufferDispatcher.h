@@ -45,6 +45,8 @@ namespace ToolFramework{
 	if(buffer == 0 || algorithms == 0 || job_queue == 0 || job_pool == 0) return false; 	
 		
 	m_util.CreateThread("BufferDispatcher", &Thread, &args);
+
+	return true;
 	
       }
       
@@ -68,14 +70,14 @@ namespace ToolFramework{
       static void Thread(Thread_args* arg){  
 	BufferDispatcher_args<T>* args=reinterpret_cast<BufferDispatcher_args<T>*>(arg);
 	if(args->algorithms->size()==0){
-	  usleep(100); 
+	  args->Sleep(10000); 
 	  return;	
 	}
 
 	args->buffer->Swap(args->local_buffer);
 	
 	if(args->local_buffer.size() == 0){
-	  usleep(100);
+	  args->buffer->Wait(args, 10000); // woken by Buffer::Add
 	  return;
 	}
 	
@@ -89,6 +91,8 @@ namespace ToolFramework{
 	    args->job->fail_func = args->algorithms->at(j).fail_func;
 	    args->job->data = args->algorithms->at(j).setup_func(args->local_buffer.at(i));
 	    args->job->out_pool = args->job_pool;
+	    args->job->priority = 0;
+	    args->job->deadline = std::chrono::steady_clock::time_point();
 	    
 	    args->job_queue->AddJob(args->job);
 	    args->job = 0;
@@ -1,4 +1,5 @@
 #include <Job.h>
+#include <JobQueue.h>
 
 using namespace ToolFramework;
 
@@ -11,4 +12,70 @@ Job::Job(std::string id){
   func = 0;
   fail_func = 0;
   out_deque = 0;
+  out_pool = 0;
+  m_queue_stats = 0;
+  m_queue_serial = 0;
+  priority = 0;
+  deadline = std::chrono::steady_clock::time_point();
+  m_dependency_failed = false;
+  m_waiting_on = 0;
+  m_dependency_queue = 0;
+  m_released = false;
+}
+
+bool Job::Expired(){
+
+  return deadline != std::chrono::steady_clock::time_point() && std::chrono::steady_clock::now() > deadline;
+
+}
+
+void Job::After(Job* predecessor){
+
+  if(!predecessor) return;
+  // first dependency also takes a hold released by JobQueue::AddJob, so predecessors finishing before then cant queue the job early
+  if(!m_waiting_on.load()){
+    m_dependency_failed = false;
+    m_waiting_on++;
+  }
+  std::lock_guard<std::mutex> lock(predecessor->m_dependency_lock);
+  if(predecessor->m_released){ // already finished, nothing to wait for
+    if(predecessor->m_failed) m_dependency_failed = true;
+    return;
+  }
+  m_waiting_on++;
+  predecessor->m_dependents.push_back(this);
+
+}
+
+Job* Job::Then(Job* continuation){
+
+  if(continuation) continuation->After(this);
+  return continuation;
+
+}
+
+void Job::ReleaseDependents(){
+
+  std::vector<Job*> dependents;
+  m_dependency_lock.lock();
+  m_released = true;
+  dependents.swap(m_dependents);
+  m_dependency_lock.unlock();
+
+  for(unsigned int i = 0; i < dependents.size(); i++){
+    Job* dependent = dependents.at(i);
+    if(m_failed) dependent->m_dependency_failed = true;
+    if(--dependent->m_waiting_on) continue;
+    dependent->m_dependency_lock.lock();
+    JobQueue* queue = dependent->m_dependency_queue;
+    dependent->m_dependency_queue = 0;
+    dependent->m_dependency_lock.unlock();
+    if(!queue){ // its queue was destroyed while it waited, so it is disposed of like the jobs that were queued
+      dependent->m_failed = true;
+      dependent->ReleaseDependents();
+      delete dependent;
+    }
+    else if(!queue->Unpark(dependent)) std::clog<<"ERROR Job::ReleaseDependents : could not queue \""<<dependent->m_id<<"\" after its dependencies finished"<<std::endl;
+  }
+
 }
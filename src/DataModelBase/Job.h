@@ -2,16 +2,22 @@
 #define JOB_H
 
 #include <string>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include <Pool.h>
 
 namespace ToolFramework{
 
   class JobDeque;
+  class JobQueue;
+  struct QueueStats;
   
 /**
    * \class Job
    *
-   * A class to store jobs for worker threads
+   * A class to store jobs for worker threads. Jobs can depend on others with After or Then, a job added to a JobQueue is then held back until all its predecessors have finished and is failed without running if any of them failed. Dependencies should be declared before the predecessor is added to a queue, After can be called while the predecessor runs but a predecessor that has already finished is not waited for
    *
    * $Author: B.Richards $
    * $Date: 2024/06/08 1:17:00 $
@@ -32,10 +38,27 @@ namespace ToolFramework{
     std::string m_id = ""; ///< string to hold id
     JobDeque* out_deque = 0; ///< output deque to place finished job
     Pool<Job>* out_pool = 0; ///< output pool to place finished jobs
+    unsigned int priority = 0; ///< jobs with a higher priority are taken off the queue first
+    std::chrono::steady_clock::time_point deadline; ///< optional time by which the job must start, jobs still queued after it are failed instead of run. Left default there is no deadline
+    bool Expired(); ///< true if the job has a deadline that has passed
+    void After(Job* predecessor); ///< hold this job back until predecessor has finished, if it has already finished since it was last added to a queue the job only inherits its failure @param predecessor job that must finish first
+    Job* Then(Job* continuation); ///< run continuation after this job, returns continuation so calls can be chained @param continuation job to run next
+    void ReleaseDependents(); ///< called once the job has finished (after fail_func if it failed) to queue jobs waiting on it, done by WorkerPoolManager workers. Dependents whose queue has been destroyed are deleted once nothing else holds them back
+    bool m_dependency_failed; ///< if a predecessor failed, the job is then failed rather than run
+    QueueStats* m_queue_stats = 0; ///< stats entry of the last queue the job was added to, cached to avoid a map search per job
+    unsigned long m_queue_serial = 0; ///< serial of the queue m_queue_stats belongs to
+    std::string m_queue_stats_id = ""; ///< id m_queue_stats was looked up with
 
 
   private:
 
+    friend class JobQueue;
+
+    std::vector<Job*> m_dependents; ///< jobs waiting on this one
+    std::atomic<unsigned int> m_waiting_on; ///< unfinished predecessors, plus one until the job is added to a queue
+    JobQueue* m_dependency_queue; ///< queue the job was added to while waiting, 0 if it was destroyed meanwhile
+    std::mutex m_dependency_lock; ///< guards m_dependents, m_released and m_dependency_queue, as After and JobQueue's destructor may run while the job finishes on a worker
+    bool m_released; ///< set once ReleaseDependents has run, until the job is next added to a queue
     
   };  
 
@@ -2,6 +2,10 @@
 
 using namespace ToolFramework;
 
+static thread_local JobQueue* local_queue = 0;
+static thread_local LocalJobDeque* local_deque = 0;
+static thread_local std::map<std::pair<unsigned long, std::string>, QueueStats*> local_stats; // stats entries this thread has looked up, by queue serial and job id. Serials are never reused so entries of destroyed queues are never matched
+
 
 QueueStats::QueueStats(){
 
@@ -18,17 +22,202 @@ void QueueStats::Clear(){
 
 
 
-JobQueue::JobQueue(){}
+LocalJobDeque::LocalJobDeque(){
+
+  size = 0;
+
+}
+
+JobQueue::JobQueue(unsigned int lock_free_capacity){
+
+  static std::atomic<unsigned long> serial(0);
+  m_serial = ++serial;
+  m_size = 0;
+  m_num_waiters = 0;
+  m_prioritised = 0;
+  m_ring = 0;
+  m_ring_mask = 0;
+  m_enqueue_pos = 0;
+  m_dequeue_pos = 0;
+
+  if(lock_free_capacity){
+    unsigned long slots = 2;
+    while(slots < lock_free_capacity) slots <<= 1;
+    m_ring = new JobQueueCell[slots];
+    m_ring_mask = slots - 1;
+    for(unsigned long i = 0; i < slots; i++){
+      m_ring[i].sequence.store(i, std::memory_order_relaxed);
+      m_ring[i].job = 0;
+    }
+  }
+
+}
 
 JobQueue::~JobQueue(){
 
+  // jobs waiting on predecessors are detached so the predecessors dont queue them here once they finish
   m_lock.lock();
-  while(m_jobs.size()){
-    delete m_jobs.front();
-    m_jobs.front()=0;
-    m_jobs.pop();
+  std::set<Job*> parked;
+  parked.swap(m_parked);
+  m_lock.unlock();
+  for(std::set<Job*>::iterator it = parked.begin(); it != parked.end(); it++){
+    (*it)->m_dependency_lock.lock();
+    (*it)->m_dependency_queue = 0;
+    (*it)->m_dependency_lock.unlock();
+  }
+
+  Job* job = 0;
+  while((job = Pop())){
+    job->m_failed = true; // never run, so jobs waiting on it fail too
+    job->ReleaseDependents();
+    delete job;
+  }
+
+  delete[] m_ring;
+  m_ring = 0;
+
+}
+
+bool JobQueue::Push(Job* job){
+
+  if(!m_ring || job->priority){
+    m_lock.lock();
+    m_jobs[job->priority].push(job);
+    if(m_ring) m_prioritised++;
+    m_size++;
+    m_lock.unlock();
+    return true;
+  }
+
+  JobQueueCell* cell = 0;
+  unsigned long pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  while(true){
+    cell = &m_ring[pos & m_ring_mask];
+    long dif = (long)cell->sequence.load(std::memory_order_acquire) - (long)pos;
+    if(dif == 0){
+      if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    }
+    else if(dif < 0) return false; // ring full
+    else pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  }
+  cell->job = job;
+  m_size++;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+
+  return true;
+
+}
+
+Job* JobQueue::Pop(){
+
+  if(!m_ring || m_prioritised.load()){
+    m_lock.lock();
+    for(std::map<unsigned int, std::queue<Job*> >::reverse_iterator it = m_jobs.rbegin(); it != m_jobs.rend(); it++){
+      if(!it->second.size()) continue;
+      Job* ret = it->second.front();
+      it->second.front()=0;
+      it->second.pop();
+      if(m_ring) m_prioritised--;
+      m_size--;
+      m_lock.unlock();
+      return ret;
+    }
+    m_lock.unlock();
+    if(!m_ring) return 0;
+  }
+
+  JobQueueCell* cell = 0;
+  unsigned long pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  while(true){
+    cell = &m_ring[pos & m_ring_mask];
+    long dif = (long)cell->sequence.load(std::memory_order_acquire) - (long)(pos + 1);
+    if(dif == 0){
+      if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    }
+    else if(dif < 0) return 0; // ring empty
+    else pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  }
+  Job* ret = cell->job;
+  cell->job = 0;
+  m_size--;
+  cell->sequence.store(pos + m_ring_mask + 1, std::memory_order_release);
+
+  return ret;
+
+}
+
+QueueStats* JobQueue::Stats(Job* job){
+
+  if(job->m_queue_stats && job->m_queue_serial == m_serial && job->m_queue_stats_id == job->m_id) return job->m_queue_stats;
+
+  QueueStats*& stats = local_stats[std::make_pair(m_serial, job->m_id)];
+  if(!stats){
+    m_stats_lock.lock();
+    stats = &m_stats[job->m_id];
+    m_stats_lock.unlock();
+  }
+  job->m_queue_stats = stats;
+  job->m_queue_serial = m_serial;
+  job->m_queue_stats_id = job->m_id;
+
+  return job->m_queue_stats;
+
+}
+
+void JobQueue::SetLocal(JobQueue* queue, LocalJobDeque* local){
+
+  local_queue = queue;
+  local_deque = local;
+
+}
+
+Job* JobQueue::GetLocalJob(LocalJobDeque* local, bool steal){
+
+  if(!local->size.load(std::memory_order_relaxed)) return 0;
+
+  local->lock.lock();
+  if(!local->jobs.size()){
+    local->lock.unlock();
+    return 0;
+  }
+  Job* ret = 0;
+  if(steal){
+    ret = local->jobs.front();
+    local->jobs.pop_front();
+  }
+  else{
+    ret = local->jobs.back();
+    local->jobs.pop_back();
+  }
+  local->size--;
+  m_size--;
+  local->lock.unlock();
+  Stats(ret)->queued--;
+
+  return ret;
+
+}
+
+void JobQueue::Requeue(LocalJobDeque* local){
+
+  // taken off under the deque's lock but pushed after releasing it, so thieves arent blocked while the shared queue is busy
+  local->lock.lock();
+  std::vector<Job*> jobs(local->jobs.begin(), local->jobs.end());
+  local->jobs.clear();
+  local->size = 0;
+  m_size -= jobs.size();
+  local->lock.unlock();
+
+  for(unsigned int i = 0; i < jobs.size(); i++){
+    if(!Push(jobs[i])){ // ring full, hold it with the prioritised jobs rather than waiting for workers to drain the ring
+      m_lock.lock();
+      m_jobs[jobs[i]->priority].push(jobs[i]);
+      m_prioritised++;
+      m_size++;
+      m_lock.unlock();
+    }
+    WakeOne();
   }
- m_lock.unlock();
 
 }
 
@@ -38,13 +227,44 @@ bool JobQueue::AddJob(Job* job){
     job->m_complete=false;
     job->m_in_progress=false;
     job->m_failed=false;
-    m_lock.lock();
-    m_jobs.push(job);
-    m_stats[job->m_id].submitted++;
-    m_stats[job->m_id].queued++;
-    m_lock.unlock();
-    
-    return true;
+    if(job->m_released){
+      job->m_dependency_lock.lock();
+      job->m_released=false;
+      job->m_dependency_lock.unlock();
+    }
+    if(job->m_waiting_on.load()){ // held until its predecessors finish, the last to do so queues it
+      job->m_dependency_lock.lock();
+      job->m_dependency_queue = this;
+      job->m_dependency_lock.unlock();
+      m_lock.lock();
+      m_parked.insert(job);
+      m_lock.unlock();
+      if(--job->m_waiting_on) return true;
+      m_lock.lock(); // its predecessors had all finished
+      m_parked.erase(job);
+      m_lock.unlock();
+      job->m_dependency_lock.lock();
+      job->m_dependency_queue = 0;
+      job->m_dependency_lock.unlock();
+    }
+    QueueStats* stats = Stats(job);
+    stats->submitted++;
+    stats->queued++;
+    if(local_deque && local_queue==this && !job->priority){
+      local_deque->lock.lock();
+      local_deque->jobs.push_back(job);
+      local_deque->size++;
+      m_size++;
+      local_deque->lock.unlock();
+      WakeOne();
+      return true;
+    }
+    if(Push(job)){
+      WakeOne();
+      return true;
+    }
+    stats->submitted--;
+    stats->queued--;
   }
   return false;
   
@@ -52,69 +272,109 @@ bool JobQueue::AddJob(Job* job){
 
 Job* JobQueue::GetJob(){
 
-  m_lock.lock();
-  if(!m_jobs.size()){
-    m_lock.unlock();
-    return 0;
-  } 
-  Job* ret = m_jobs.front();
-  m_jobs.front()=0;
-  m_jobs.pop();
-  m_stats[ret->m_id].queued--;
-  m_lock.unlock();
+  Job* ret = Pop();
+  if(ret) Stats(ret)->queued--;
   return ret;
+
 }
 
 bool JobQueue::pop(){
 
-  m_lock.lock();
-  if(m_jobs.size()){
-    m_stats[m_jobs.front()->m_id].queued--;
-     m_jobs.pop();
-     m_lock.unlock();
-    return true;
-  }
-  m_lock.unlock();
-  return false;
+  Job* job = Pop();
+  if(!job) return false;
+  Stats(job)->queued--;
+  return true;
+
 }
 
 unsigned int JobQueue::size(){
 
+  return m_size.load(std::memory_order_relaxed);
+
+}
+
+bool JobQueue::Wait(Thread_args* args, unsigned int timeout_us){
+
+  // registering before checking the size means a job added concurrently either is seen here or wakes this thread
+  m_wait_lock.lock();
+  m_waiters.push_back(args);
+  m_num_waiters++;
+  m_wait_lock.unlock();
+
+  if(!m_size.load()) args->Sleep(timeout_us);
+
+  m_wait_lock.lock();
+  for(std::deque<Thread_args*>::iterator it = m_waiters.begin(); it != m_waiters.end(); it++){
+    if(*it == args){
+      m_waiters.erase(it);
+      m_num_waiters--;
+      break;
+    }
+  }
+  m_wait_lock.unlock();
+
+  return size() > 0;
+
+}
+
+bool JobQueue::Unpark(Job* job){
+
   m_lock.lock();
-  unsigned int tmp= m_jobs.size();
-  m_lock.unlock(); 
-  return tmp; 
+  m_parked.erase(job);
+  m_lock.unlock();
+
+  return AddJob(job);
+
+}
+
+void JobQueue::WakeOne(){
+
+  if(!m_num_waiters.load()) return;
+
+  m_wait_lock.lock();
+  if(m_waiters.size()){
+    m_waiters.front()->Wake();
+    m_waiters.pop_front();
+    m_num_waiters--;
+  }
+  m_wait_lock.unlock();
+
+}
+
+unsigned int JobQueue::capacity(){
+
+  return m_ring ? m_ring_mask + 1 : 0;
 
 }
 
 void JobQueue::Print(){
 
-  m_lock.lock();
+  m_stats_lock.lock();
   printf("Total jobs queued = %u\n", size());
   for(std::map<std::string, QueueStats>::iterator it = m_stats.begin(); it!=m_stats.end(); it++){
-    printf("  %s : submitted = %lu, queued = %lu \n", it->first.c_str(), it->second.submitted, it->second.queued);
+    printf("  %s : submitted = %lu, queued = %lu \n", it->first.c_str(), it->second.submitted.load(), it->second.queued.load());
   }
-  m_lock.unlock();
+  m_stats_lock.unlock();
   
 }
 
 void JobQueue::ClearStats(){
 
-  m_lock.lock();
-  m_stats.clear();
-  m_lock.unlock();
+  // entries are zeroed rather than erased as jobs hold pointers to them
+  m_stats_lock.lock();
+  for(std::map<std::string, QueueStats>::iterator it = m_stats.begin(); it!=m_stats.end(); it++) it->second.Clear();
+  m_stats_lock.unlock();
 
 }
 
 void JobQueue::Clear(){
 
-  m_lock.lock();
-  while(m_jobs.size()){
-    delete m_jobs.front();
-    m_jobs.front()=0;
-    m_jobs.pop();
+  Job* job = 0;
+  while((job = Pop())){
+    job->m_failed = true;
+    job->ReleaseDependents();
+    delete job;
   }
-  m_stats.clear();
-  m_lock.unlock();
+  ClearStats();
   
 }
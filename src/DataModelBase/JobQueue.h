@@ -2,9 +2,13 @@
 #define JOB_QUEUE_H
 
 #include <queue>
+#include <deque>
+#include <vector>
 #include <mutex>
+#include <atomic>
 #include <Job.h>
 #include <map>
+#include <set>
 
 namespace ToolFramework{
 
@@ -21,15 +25,49 @@ namespace ToolFramework{
 
     QueueStats();
     void Clear();
-    unsigned long submitted;
-    unsigned long queued;    
+    std::atomic<unsigned long> submitted;
+    std::atomic<unsigned long> queued;    
+
+  };
+
+ /**
+   * \struct JobQueueCell
+   *
+   * A slot of the lock free job ring. The sequence number tells producers and consumers whose turn it is to use the slot
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  struct JobQueueCell{
+
+    std::atomic<unsigned long> sequence;
+    Job* job;
+
+  };
+
+  /**
+   * \struct LocalJobDeque
+   *
+   * A deque of jobs owned by one work stealing worker thread. The owner takes jobs from the back and idle workers steal from the front
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  struct LocalJobDeque{
+
+    LocalJobDeque();
+    std::deque<Job*> jobs;
+    std::mutex lock;
+    std::atomic<unsigned int> size;
 
   };
 
   /**
    * \class JobQueue
    *
-   * A class that is a queue of jobs for worker threads
+   * A class that is a queue of jobs for worker threads. By default jobs are held in a mutex guarded queue of unlimited size, alternativly a capacity can be given to hold them in a bounded lock free multi producer multi consumer ring. Jobs with a higher Job::priority are served first, jobs of equal priority in the order they were added. When using the ring only priority 0 jobs are held in it, jobs with a priority go in a mutex guarded queue that is checked first.
    *
    * $Author: B.Richards $
    * $Date: 2024/06/08 1:17:00 $
@@ -39,16 +77,19 @@ namespace ToolFramework{
   class JobQueue{
 
     friend class WorkerPoolManager;
+    friend class Job;
     
   public:
     
-    JobQueue(); ///< simple constructor
-    ~JobQueue(); ///< simple destructor
+    JobQueue(unsigned int lock_free_capacity=0); ///< simple constructor @param lock_free_capacity if non zero jobs are held in a lock free ring of this many slots (rounded up to a power of two) and AddJob fails when it is full
+    ~JobQueue(); ///< destructor, deleting queued jobs. Jobs still waiting on predecessors are deleted when those finish instead of being queued, destroy the queue after the threads using it
     
-    bool AddJob(Job* job); ///< fucntion to adda  job to the queue @param job pointer to the job to add
+    bool AddJob(Job* job); ///< fucntion to adda  job to the queue, jobs with unfinished predecessors are held and queued once they finish @param job pointer to the job to add
     Job* GetJob(); ///< function to get job from the front of the queue, the function pops the job off the queue
     bool pop(); ///< function to pop a job off the front of the queue
     unsigned int size(); ///< function to return number of jobs in the queue
+    unsigned int capacity(); ///< function to return the number of slots in the lock free ring, 0 if the queue is unbounded
+    bool Wait(Thread_args* args, unsigned int timeout_us); ///< function for a consumer thread to sleep until a job is added, it is woken or the timeout passes. Each AddJob wakes one waiting thread. Returns true if there are jobs queued @param args thread args of the calling thread @param timeout_us maximum time to sleep in microseconds
     void Print();
     void ClearStats();
     void Clear();
@@ -56,10 +97,35 @@ namespace ToolFramework{
     bool pause =false;
     
   private:
+
+    bool Push(Job* job); ///< add a job to the underlying queue or ring
+    Job* Pop(); ///< take a job off the underlying queue or ring, 0 if empty
+    QueueStats* Stats(Job* job); ///< stats entry for the jobs id, cached on the job and per thread so m_stats is only searched, under m_stats_lock, the first time a thread sees an id on this queue
+    static void SetLocal(JobQueue* queue, LocalJobDeque* local); ///< register the local deque jobs added to queue from the calling thread are placed on, 0 to unregister
+    Job* GetLocalJob(LocalJobDeque* local, bool steal=false); ///< take a job off a local deque, from the back for its owner or the front when stealing
+    void Requeue(LocalJobDeque* local); ///< move any jobs left on a local deque to the shared queue, into the mutex guarded queue if the ring is full
+    void WakeOne(); ///< wake the longest waiting thread sleeping in Wait
+    bool Unpark(Job* job); ///< queue a job whose predecessors have all finished
     
-    std::queue<Job*> m_jobs;
+    std::map<unsigned int, std::queue<Job*> > m_jobs; ///< jobs by priority
+    std::set<Job*> m_parked; ///< jobs added while waiting on predecessors, guarded by m_lock
+    std::atomic<unsigned int> m_prioritised; ///< number of jobs in m_jobs when using the ring
     std::mutex m_lock;
     std::map<std::string, QueueStats> m_stats;
+    std::mutex m_stats_lock;
+    std::atomic<unsigned int> m_size;
+    unsigned long m_serial; ///< unique number for this queue, used to validate stats cached on jobs
+    std::deque<Thread_args*> m_waiters; ///< threads sleeping in Wait
+    std::atomic<unsigned int> m_num_waiters;
+    std::mutex m_wait_lock;
+
+    JobQueueCell* m_ring;
+    unsigned long m_ring_mask;
+    char m_pad0[64];
+    std::atomic<unsigned long> m_enqueue_pos; ///< kept on its own cache line from m_dequeue_pos so producers and consumers dont share one
+    char m_pad1[64];
+    std::atomic<unsigned long> m_dequeue_pos;
+    char m_pad2[64];
   
   };
 
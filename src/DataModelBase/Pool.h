@@ -97,7 +97,7 @@ namespace ToolFramework{
       Pool_args<T>* args = reinterpret_cast<Pool_args<T>*>(arg);
       args->count = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - args->managing_timer).count();
       if(args->count < args->manage_period_ms){
-	usleep((args->manage_period_ms - args->count)*1000);
+	args->Sleep((args->manage_period_ms - args->count)*1000);
 	return;
       }
       args->mtx->lock();
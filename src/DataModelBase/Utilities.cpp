@@ -2,6 +2,34 @@
 
 using namespace ToolFramework;
 
+bool Thread_args::Sleep(unsigned int us){
+
+  std::unique_lock<std::mutex> lock(wake_mtx);
+  if(!woken) wake_cv.wait_for(lock, std::chrono::microseconds(us)); // KillThread also wakes
+  bool ret = woken;
+  woken = false;
+  
+  return ret;
+
+}
+
+void Thread_args::ClearWake(){
+
+  wake_mtx.lock();
+  woken = false;
+  wake_mtx.unlock();
+
+}
+
+void Thread_args::Wake(){
+
+  wake_mtx.lock();
+  woken = true;
+  wake_mtx.unlock();
+  wake_cv.notify_one();
+
+}
+
 Utilities::Utilities(){ 
   Threads.clear();
 }
@@ -38,6 +66,7 @@ void *Utilities::Thread(void *arg){
   while (!args->kill){
     
     if(args->running){
+      args->ClearWake(); // a wake for work already done by the last iteration shouldnt cut this one's sleep short
       try{
         args->func(args);
       }
@@ -50,7 +79,7 @@ void *Utilities::Thread(void *arg){
         args->running = false;
       }
     }
-    else usleep(100);
+    else args->Sleep(100); // woken by StartThread and KillThread, the timeout catches running being set directly
   
   }
   
@@ -67,6 +96,7 @@ bool Utilities::KillThread(Thread_args* &args){
     
     args->running=false;
     args->kill=true;
+    args->Wake();
     
     pthread_join(args->thread, NULL);
    
@@ -87,6 +117,25 @@ bool Utilities::KillThread(Thread_args* &args){
   
 }
 
+bool Utilities::StartThread(Thread_args* args){
+
+  if(!args || !args->thread) return false;
+  args->running=true;
+  args->Wake();
+
+  return true;
+
+}
+
+bool Utilities::PauseThread(Thread_args* args){
+
+  if(!args || !args->thread) return false;
+  args->running=false;
+
+  return true;
+
+}
+
 bool Utilities::KillThread(std::string ThreadName){
   if(Threads.count(ThreadName) == 0 ) return false;
   return KillThread(Threads[ThreadName]);
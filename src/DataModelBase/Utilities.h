@@ -7,6 +7,8 @@
 #include <map>
 #include <Store.h>
 #include <unistd.h>
+#include <mutex>
+#include <condition_variable>
 
 namespace ToolFramework{
   
@@ -28,6 +30,7 @@ namespace ToolFramework{
       kill=false;
       running=false;
       thread=0;
+      woken=false;
     }
     
     virtual ~Thread_args(){ ///< virtual constructor 
@@ -40,6 +43,16 @@ namespace ToolFramework{
     pthread_t thread; ///< Simple constructor underlying thread that interface is built ontop of
     bool running; ///< Bool flag to tell the thread to run (if not set thread goes into wait cycle
     bool kill; ///< Bool flay used to kill the thread
+
+    bool Sleep(unsigned int us); ///< Sleep the thread for up to us microseconds, returning early (true) if woken with Wake or killed. Use in place of usleep in thread functions
+    void Wake(); ///< Wake the thread from Sleep, if it is not sleeping its next Sleep returns immediately
+    void ClearWake(); ///< Forget a Wake that arrived while the thread was not sleeping, called by Utilities::Thread before each run of the thread function
+    
+  private:
+    
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;
+    bool woken;
     
   };
   
@@ -61,6 +74,8 @@ namespace ToolFramework{
     
     Utilities(); ///< Simple constructor
     Thread_args* CreateThread(std::string ThreadName,  void (*func)(Thread_args*), Thread_args* args, bool start=true); ///< Create a thread with more complicated data exchange definned by arguments
+    bool StartThread(Thread_args* args); ///< Set a thread running and wake it immediately
+    bool PauseThread(Thread_args* args); ///< Stop a thread running its function, it then sleeps until started or killed
     bool KillThread(Thread_args* &args); ///< Kill a thread assosiated to args
     bool KillThread(std::string ThreadName); ///< Kill a thread by name
     
@@ -7,18 +7,32 @@ PoolManagerStats::PoolManagerStats(){
   processing = 0;
   completed = 0 ;
   failed = 0;
+  expired = 0;
 
 }
 
-PoolWorker_args::PoolWorker_args() : Thread_args() {}
+PoolWorker_args::PoolWorker_args() : Thread_args() {
 
-PoolWorker_args::~PoolWorker_args() {}
+  local_jobs = 0;
+  peers = 0;
+  peers_mtx = 0;
+  steal_start = 0;
+  manager = 0;
+
+}
+
+PoolWorker_args::~PoolWorker_args() {
+
+  delete local_jobs;
+  local_jobs = 0;
+
+}
 
 PoolManager_args::PoolManager_args() : Thread_args() {}
 
 PoolManager_args::~PoolManager_args() {}
 
-WorkerPoolManager::WorkerPoolManager(JobQueue& job_queue, unsigned int* thread_cap, unsigned int* global_thread_cap, std::atomic<unsigned int>* global_thread_num, JobDeque* job_out_deque, bool self_serving, bool threaded, unsigned int thread_sleep_us, unsigned int thread_management_period_us, unsigned int job_assignment_period_us){
+WorkerPoolManager::WorkerPoolManager(JobQueue& job_queue, unsigned int* thread_cap, unsigned int* global_thread_cap, std::atomic<unsigned int>* global_thread_num, JobDeque* job_out_deque, bool self_serving, bool threaded, unsigned int thread_sleep_us, unsigned int thread_management_period_us, unsigned int job_assignment_period_us, bool work_stealing){
 
   //m_util = new Utilities();
   
@@ -29,7 +43,8 @@ WorkerPoolManager::WorkerPoolManager(JobQueue& job_queue, unsigned int* thread_c
   m_manager_args.global_thread_cap = global_thread_cap;
   m_manager_args.global_thread_num = global_thread_num;
   m_manager_args.job_out_deque = job_out_deque;
-  m_manager_args.self_serving= self_serving;
+  m_manager_args.self_serving= self_serving || work_stealing;
+  m_manager_args.work_stealing = work_stealing;
   m_manager_args.thread_sleep_us = thread_sleep_us;
   m_manager_args.thread_management_period_us = thread_management_period_us;
   m_manager_args.job_assignment_period_us = job_assignment_period_us;
@@ -40,7 +55,7 @@ WorkerPoolManager::WorkerPoolManager(JobQueue& job_queue, unsigned int* thread_c
   m_manager_args.sleep = false;
   m_manager_args.sleep_us = ( m_manager_args.thread_management_period_us < m_manager_args.job_assignment_period_us ? m_manager_args.thread_management_period_us : m_manager_args.job_assignment_period_us );
   
-  CreateWorkerThread(m_manager_args.args, m_manager_args.self_serving, m_manager_args.thread_sleep_us, m_manager_args.job_queue, m_manager_args.job_out_deque, m_manager_args.thread_num, &m_util, &m_manager_args.stats, &m_manager_args.stats_mtx, global_thread_num);
+  CreateWorkerThread(m_manager_args.args, m_manager_args.self_serving, m_manager_args.thread_sleep_us, m_manager_args.job_queue, m_manager_args.job_out_deque, m_manager_args.thread_num, &m_util, &m_manager_args.stats, &m_manager_args.stats_mtx, global_thread_num, (work_stealing ? &m_manager_args.peers : 0), &m_manager_args.peers_mtx, &m_manager_args);
 
   m_manager_args.free_threads = 1;
   if (m_threaded) CreateManagerThread();
@@ -56,6 +71,10 @@ WorkerPoolManager::~WorkerPoolManager() {
   }
 
   m_util.KillThread(&m_manager_args);
+
+  m_manager_args.peers_mtx.lock();
+  m_manager_args.peers.clear();
+  m_manager_args.peers_mtx.unlock();
  
   for (unsigned int i = 0; i < m_manager_args.args.size(); i++){
 
@@ -81,7 +100,7 @@ void WorkerPoolManager::CreateManagerThread() {
 }
 
 
-void WorkerPoolManager::CreateWorkerThread(std::vector<PoolWorker_args*>& in_args, bool &in_self_serving, unsigned int &in_thread_sleep_us, JobQueue* in_job_queue, JobDeque* in_job_out_deque,unsigned long &thread_num, Utilities* in_util, std::map<std::string,PoolManagerStats>* in_stats, std::mutex* in_stats_mtx, std::atomic<unsigned int>* global_thread_num) {
+void WorkerPoolManager::CreateWorkerThread(std::vector<PoolWorker_args*>& in_args, bool &in_self_serving, unsigned int &in_thread_sleep_us, JobQueue* in_job_queue, JobDeque* in_job_out_deque,unsigned long &thread_num, Utilities* in_util, std::map<std::string,PoolManagerStats>* in_stats, std::mutex* in_stats_mtx, std::atomic<unsigned int>* global_thread_num, std::vector<LocalJobDeque*>* in_peers, std::mutex* in_peers_mtx, Thread_args* in_manager) {
   PoolWorker_args* tmparg = new PoolWorker_args();
   tmparg->busy = false;
   tmparg->thread_sleep_us = in_thread_sleep_us;
@@ -92,6 +111,16 @@ void WorkerPoolManager::CreateWorkerThread(std::vector<PoolWorker_args*>& in_arg
   tmparg->stats_mtx = in_stats_mtx;
   if(in_self_serving) tmparg->job_queue=in_job_queue;
   tmparg->self_serving = in_self_serving;
+  tmparg->manager = in_manager;
+  if(in_peers){
+    tmparg->local_jobs = new LocalJobDeque();
+    tmparg->peers = in_peers;
+    tmparg->peers_mtx = in_peers_mtx;
+    tmparg->steal_start = thread_num;
+    in_peers_mtx->lock();
+    in_peers->push_back(tmparg->local_jobs);
+    in_peers_mtx->unlock();
+  }
   in_args.push_back(tmparg);
   std::stringstream tmp;
   tmp << "T" << thread_num;
@@ -101,22 +130,57 @@ void WorkerPoolManager::CreateWorkerThread(std::vector<PoolWorker_args*>& in_arg
 }
 
 void WorkerPoolManager::DeleteWorkerThread(unsigned int pos,  Utilities* in_util, std::vector<PoolWorker_args*> &in_args, std::atomic<unsigned int>* global_thread_num) {
-  in_util->KillThread(in_args.at(pos));
+  PoolWorker_args* tmparg = in_args.at(pos);
+  if(tmparg->local_jobs){
+    tmparg->peers_mtx->lock();
+    for(unsigned int i = 0; i < tmparg->peers->size(); i++){
+      if(tmparg->peers->at(i) == tmparg->local_jobs){
+	tmparg->peers->erase(tmparg->peers->begin() + i);
+	break;
+      }
+    }
+    tmparg->peers_mtx->unlock();
+  }
+  in_util->KillThread(tmparg);
+  if(tmparg->local_jobs) tmparg->job_queue->Requeue(tmparg->local_jobs);
   delete in_args.at(pos);
   in_args.at(pos) = 0;
   in_args.erase(in_args.begin() + pos );
   if(global_thread_num) (*global_thread_num)--;
 }
 
+Job* WorkerPoolManager::StealJob(PoolWorker_args* args) {
+
+  Job* job = args->job_queue->GetLocalJob(args->local_jobs);
+  if(job) return job;
+  
+  job = args->job_queue->GetJob();
+  if(job) return job;
+
+  args->peers_mtx->lock();
+  unsigned int num = args->peers->size();
+  for(unsigned int i = 0; i < num && !job; i++){
+    LocalJobDeque* victim = args->peers->at((args->steal_start + i) % num);
+    if(victim != args->local_jobs) job = args->job_queue->GetLocalJob(victim, true);
+  }
+  args->peers_mtx->unlock();
+  args->steal_start++;
+
+  return job;
+
+}
+
 void WorkerPoolManager::WorkerThread(Thread_args* arg) {
   PoolWorker_args* args = reinterpret_cast<PoolWorker_args*>(arg);
 
-  if ((!args->busy && !args->self_serving) || (args->self_serving && !args->job_queue->size())) usleep(args->thread_sleep_us);
+  if (!args->busy && !args->self_serving) args->Sleep(args->thread_sleep_us); // woken by the manager assigning a job
+  else if (args->self_serving && !args->job_queue->size()) args->job_queue->Wait(args, args->thread_sleep_us);
   else {
     if(args->self_serving){
-      args->job=args->job_queue->GetJob();
+      if(args->local_jobs) args->job=StealJob(args);
+      else args->job=args->job_queue->GetJob();
       if(!args->job){
-	usleep(args->thread_sleep_us);
+	args->job_queue->Wait(args, args->thread_sleep_us);
 	return;
       }
 
@@ -127,7 +191,18 @@ void WorkerPoolManager::WorkerThread(Thread_args* arg) {
       args->busy = true;
     }
     
-    if(args->job){
+    if(args->job && args->job->m_dependency_failed){ // a predecessor failed so failed without running
+      args->job->m_failed=true;
+      args->job->m_dependency_failed=false;
+    }
+    else if(args->job && args->job->Expired()){ // past its deadline so failed without running
+      args->job->m_failed=true;
+      args->stats_mtx->lock();
+      (*args->stats)[args->job->m_id].expired++;
+      args->stats_mtx->unlock();
+    }
+    else if(args->job){
+      if(args->local_jobs) JobQueue::SetLocal(args->job_queue, args->local_jobs);
       try{
 	if(args->job->func(args->job->data)){
 	  args->job->m_complete=true;
@@ -146,6 +221,7 @@ void WorkerPoolManager::WorkerThread(Thread_args* arg) {
 	std::clog<<"Job Failed \""<<args->job->m_id<<"\""<<std::endl;
 	args->job->m_failed=true;
       }
+      if(args->local_jobs) JobQueue::SetLocal(0, 0);
     }
     else{
       std::clog<<"Job Failed \""<<args->job->m_id<<"\": null job pointer"<<std::endl;
@@ -168,6 +244,10 @@ void WorkerPoolManager::WorkerThread(Thread_args* arg) {
       }
     }
     
+    if(args->local_jobs) JobQueue::SetLocal(args->job_queue, args->local_jobs);
+    args->job->ReleaseDependents();
+    if(args->local_jobs) JobQueue::SetLocal(0, 0);
+    
     if (args->job_out_deque || args->job->out_deque) {
       if(args->job->out_deque) args->job->out_deque->push_back(args->job);
       else args->job_out_deque->push_back(args->job);
@@ -181,7 +261,8 @@ void WorkerPoolManager::WorkerThread(Thread_args* arg) {
       delete args->job;
       args->job=0;
     }
-    args->busy = false;   
+    args->busy = false;
+    if(!args->self_serving && args->manager) args->manager->Wake();
   }
   
 }
@@ -192,31 +273,22 @@ void WorkerPoolManager::ManagerThread(Thread_args* arg) {
  
   args->now = std::chrono::high_resolution_clock::now();
   args->manage = std::chrono::duration<double, std::micro>(args->now - args->managing_timer).count() > args->thread_management_period_us;
+  args->serve = !args->self_serving && args->job_queue->size() > 0;
   args->sleep = !args->manage;
   
-  if(!args->self_serving){
-    args->serve = std::chrono::duration<double, std::micro>(args->now - args->serving_timer).count() > args->job_assignment_period_us;
-    args->sleep = !args->serve && !args->manage;  
-  }
-  
-  if (args->sleep){
-    usleep(args->sleep_us);
-    return;
-  }
-  
   if(args->serve){
-    if (args->job_queue->size() > 0) {
-      for (unsigned int i = 0; i < args->args.size(); i++) {
-	if (!args->args.at(i)->busy && args->job_queue->size() > 0) {
-	  args->args.at(i)->job = args->job_queue->GetJob(); 
-	  if(args->args.at(i)->job == 0) continue;
-	  args->stats_mtx.lock();
-	  args->stats[args->args.at(i)->job->m_id].processing++;
-	  args->stats_mtx.unlock();
-	  
-	  args->args.at(i)->job->m_in_progress=true;
-	  args->args.at(i)->busy = true;
-        }
+    for (unsigned int i = 0; i < args->args.size(); i++) {
+      if (!args->args.at(i)->busy && args->job_queue->size() > 0) {
+	args->args.at(i)->job = args->job_queue->GetJob(); 
+	if(args->args.at(i)->job == 0) continue;
+	args->stats_mtx.lock();
+	args->stats[args->args.at(i)->job->m_id].processing++;
+	args->stats_mtx.unlock();
+	
+	args->args.at(i)->job->m_in_progress=true;
+	args->args.at(i)->busy = true;
+	args->args.at(i)->Wake();
+	args->sleep = false;
       }
     }
     args->serving_timer = std::chrono::high_resolution_clock::now();
@@ -232,12 +304,18 @@ void WorkerPoolManager::ManagerThread(Thread_args* arg) {
       }
     }
     
-    if (args->free_threads < 1 && args->args.size()<(*(args->thread_cap)) && ( !args->global_thread_cap || (*(args->global_thread_num))<(*(args->global_thread_cap))  ) )       CreateWorkerThread(args->args, args->self_serving, args->thread_sleep_us, args->job_queue, args->job_out_deque, args->thread_num, args->util, &args->stats, &args->stats_mtx, args->global_thread_num);
+    if (args->free_threads < 1 && args->args.size()<(*(args->thread_cap)) && ( !args->global_thread_cap || (*(args->global_thread_num))<(*(args->global_thread_cap))  ) )       CreateWorkerThread(args->args, args->self_serving, args->thread_sleep_us, args->job_queue, args->job_out_deque, args->thread_num, args->util, &args->stats, &args->stats_mtx, args->global_thread_num, (args->work_stealing ? &args->peers : 0), &args->peers_mtx, args);
 
     if (args->free_threads > 1) DeleteWorkerThread(last_free, args->util, args->args, args->global_thread_num);
     
     args->managing_timer = std::chrono::high_resolution_clock::now();
   }
+
+  // sleep until a job is added, a worker finishes or the period is up
+  if (args->sleep){
+    if(!args->self_serving && !args->job_queue->size()) args->job_queue->Wait(args, args->sleep_us);
+    else args->Sleep(args->sleep_us);
+  }
   
 }
 
@@ -260,17 +338,17 @@ std::string WorkerPoolManager::GetStats(){
   std::string ret="";
  
   ret="Queued Jobs Total = " + std::to_string(m_job_queue->size()) + " : Total Workers = " + std::to_string(NumThreads()) + " \n"; 
-  m_job_queue->m_lock.lock();
+  m_job_queue->m_stats_lock.lock();
   m_manager_args.stats_mtx.lock(); 
   
   for(std::map<std::string, QueueStats>::iterator it = m_job_queue->m_stats.begin(); it!=m_job_queue->m_stats.end(); it++){
     
-    ret += "  " + it->first + ": submitted = " + std::to_string(it->second.submitted) + ", queued = " + std::to_string(it->second.queued) + ", processing = " + std::to_string(m_manager_args.stats[it->first].processing) + ", completed = " + std::to_string(m_manager_args.stats[it->first].completed) + ", failed = " + std::to_string(m_manager_args.stats[it->first].failed) +"\n"; 
+    ret += "  " + it->first + ": submitted = " + std::to_string(it->second.submitted.load()) + ", queued = " + std::to_string(it->second.queued.load()) + ", processing = " + std::to_string(m_manager_args.stats[it->first].processing) + ", completed = " + std::to_string(m_manager_args.stats[it->first].completed) + ", failed = " + std::to_string(m_manager_args.stats[it->first].failed) + ", expired = " + std::to_string(m_manager_args.stats[it->first].expired) +"\n"; 
 
   }
   
   m_manager_args.stats_mtx.unlock();
-  m_job_queue->m_lock.unlock();
+  m_job_queue->m_stats_lock.unlock();
     
 
   return ret;
@@ -280,22 +358,23 @@ std::string WorkerPoolManager::GetStats(){
 void WorkerPoolManager::GetStats(Store& output){
 
  
-  m_job_queue->m_lock.lock();
+  m_job_queue->m_stats_lock.lock();
   m_manager_args.stats_mtx.lock(); 
   
   for(std::map<std::string, QueueStats>::iterator it = m_job_queue->m_stats.begin(); it!=m_job_queue->m_stats.end(); it++){
     
     
-    output.Set( it->first + "_submitted", it->second.submitted);
-    output.Set( it->first + "_queued", it->second.queued);
+    output.Set( it->first + "_submitted", it->second.submitted.load());
+    output.Set( it->first + "_queued", it->second.queued.load());
     output.Set( it->first + "_processing", m_manager_args.stats[it->first].processing);
     output.Set( it->first + "_completed", m_manager_args.stats[it->first].completed);
     output.Set( it->first + "_failed", m_manager_args.stats[it->first].failed);
+    output.Set( it->first + "_expired", m_manager_args.stats[it->first].expired);
     
   }
   
   m_manager_args.stats_mtx.unlock();
-  m_job_queue->m_lock.unlock();
+  m_job_queue->m_stats_lock.unlock();
 
   return;
 }
@@ -27,7 +27,8 @@ namespace ToolFramework{
     PoolManagerStats();
     unsigned long processing;
     unsigned long completed;
-    unsigned long failed;
+    unsigned long failed; ///< includes expired jobs
+    unsigned long expired; ///< jobs failed for passing their deadline before they ran
 
   };
   
@@ -53,6 +54,11 @@ namespace ToolFramework{
     JobDeque* job_out_deque;
     std::map<std::string,PoolManagerStats>* stats;
     std::mutex* stats_mtx;
+    LocalJobDeque* local_jobs; ///< local deque for jobs added by this worker when work stealing, 0 otherwise
+    std::vector<LocalJobDeque*>* peers; ///< local deques of all workers to steal from
+    std::mutex* peers_mtx;
+    unsigned int steal_start; ///< position in peers to start the next steal attempt from
+    Thread_args* manager; ///< manager thread to wake when a job finishes if not self serving
   };
   
   
@@ -92,6 +98,9 @@ namespace ToolFramework{
     std::chrono::high_resolution_clock::time_point serving_timer;
     std::map<std::string,PoolManagerStats> stats;
     std::mutex stats_mtx;
+    bool work_stealing;
+    std::vector<LocalJobDeque*> peers; ///< local deques of the workers when work stealing
+    std::mutex peers_mtx;
     
   };
   /**
@@ -117,11 +126,12 @@ namespace ToolFramework{
        * @param job_out_deque optional completed job deque if you want an output list structure
        * @param self_serving whether threads help them selves to jobs or alternativly the manager will distribute jobs
        * @param threaded if the manager runs on a thread. if not it can be executed manually multiple times
-       * @param thread_sleep_us how long threds will sleep for in us if no job is available
+       * @param thread_sleep_us the longest threds will sleep for in us if no job is available, they are woken earlier when a job is added or assigned to them
        * @param thrad_management_period_us how long between evaluating the number of worker threads to avoid rapid killing and recreating
-       * @param job_assignment_period how long the managers sleeps between checking if there are free workers to assign them new jobs
+       * @param job_assignment_period the longest the managers sleeps between checking if there are free workers to assign them new jobs, it is woken earlier when a job is added or a worker finishes
+       * @param work_stealing if set each worker keeps a local deque that jobs it adds to the queue while running a job are placed on. Workers serve themselves from their own deque first, then the shared queue, then steal from other workers deques. Implies self_serving
        */
-    WorkerPoolManager(JobQueue& job_queue,  unsigned int* thread_cap=0, unsigned int* global_thread_cap=0, std::atomic<unsigned int>* global_thread_num=0, JobDeque* job_out_deque=0, bool self_serving=false, bool threaded=true, unsigned int thread_sleep_us=100, unsigned int thread_management_period_us=10000, unsigned int job_assignment_period_us=1000);
+    WorkerPoolManager(JobQueue& job_queue,  unsigned int* thread_cap=0, unsigned int* global_thread_cap=0, std::atomic<unsigned int>* global_thread_num=0, JobDeque* job_out_deque=0, bool self_serving=false, bool threaded=true, unsigned int thread_sleep_us=100, unsigned int thread_management_period_us=10000, unsigned int job_assignment_period_us=1000, bool work_stealing=false);
     ~WorkerPoolManager(); ///< Simple Destructor
     
     void ManageWorkers(); ///< Function to manage workers and distribute jobs to be run when unthreaded if you choose to not have the managment run on a thread.
@@ -134,9 +144,10 @@ namespace ToolFramework{
   private:
     
     void CreateManagerThread(); ///< Function to Create Manager Thread
-    static void CreateWorkerThread(std::vector<PoolWorker_args*> &in_args, bool &in_self_serving, unsigned int &in_thread_sleep_us, JobQueue* in_job_queue, JobDeque* in_job_out_deque,unsigned long &thread_num, Utilities* in_util, std::map<std::string,PoolManagerStats>* in_stats, std::mutex* in_stats_mtx, std::atomic<unsigned int>* global_thread_num=0 ); ///< Function to Create Worker Thread
+    static void CreateWorkerThread(std::vector<PoolWorker_args*> &in_args, bool &in_self_serving, unsigned int &in_thread_sleep_us, JobQueue* in_job_queue, JobDeque* in_job_out_deque,unsigned long &thread_num, Utilities* in_util, std::map<std::string,PoolManagerStats>* in_stats, std::mutex* in_stats_mtx, std::atomic<unsigned int>* global_thread_num=0, std::vector<LocalJobDeque*>* in_peers=0, std::mutex* in_peers_mtx=0, Thread_args* in_manager=0); ///< Function to Create Worker Thread, in_peers is given when work stealing
     static void DeleteWorkerThread(unsigned int pos,  Utilities* in_util, std::vector<PoolWorker_args*> &in_args, std::atomic<unsigned int>* global_thread_num=0); ///< Function to delete thread @param pos is the position in the args vector below
     
+    static Job* StealJob(PoolWorker_args* args); ///< Function for a work stealing worker to find its next job
     static void WorkerThread(Thread_args* arg); ///< Function to be run by the thread in a loop. Make sure not to block in it
     static void ManagerThread(Thread_args* arg); ///< Function to be run by the thread manager. Make sure not to block in it
     
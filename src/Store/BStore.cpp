@@ -1,9 +1,50 @@
 #include <BStore.h>
+#include <BStoreReader.h>
 
 #include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <climits>
 
 using namespace ToolFramework;
 
+static std::atomic<uint64_t> generations(0); // source of BStore::m_generation values
+
+static uint64_t RingAlign(uint64_t size){ return (size+63) & ~static_cast<uint64_t>(63); } // shared memory ring areas start on cache lines
+
+static std::string RingName(const std::string& name){ return name.length() && name[0]=='/' ? name : "/"+name; } // shm_open names start with a slash
+
+static_assert(sizeof(std::atomic<uint64_t>)==sizeof(uint64_t) && sizeof(std::atomic<uint32_t>)==sizeof(uint32_t), "shared memory ring atomics must be plain words");
+
+static void RingStore(char* area, const std::string& data){ // copies into the header area a word at a time, racing readers see whole words and retry
+
+  std::atomic<uint64_t>* words=reinterpret_cast<std::atomic<uint64_t>*>(area);
+  for(std::string::size_type i=0; i<data.length(); i+=sizeof(uint64_t)){
+    uint64_t word=0;
+    memcpy(&word, data.data()+i, std::min(sizeof(uint64_t), data.length()-i));
+    words[i/sizeof(uint64_t)].store(word, std::memory_order_relaxed);
+  }
+
+}
+
+static void RingLoad(const char* area, std::string& data, uint64_t length){ // copies out of the header area a word at a time
+
+  const std::atomic<uint64_t>* words=reinterpret_cast<const std::atomic<uint64_t>*>(area);
+  data.resize(static_cast<std::string::size_type>(length));
+  for(std::string::size_type i=0; i<data.length(); i+=sizeof(uint64_t)){
+    uint64_t word=words[i/sizeof(uint64_t)].load(std::memory_order_relaxed);
+    memcpy(&data[i], &word, std::min(sizeof(uint64_t), data.length()-i));
+  }
+
+}
+
 ////////////////////////
 //Notes for Ben
 ///////////////////////////////
@@ -15,11 +56,11 @@ using namespace ToolFramework;
 //better option might be to just have all but the version and type flags in the compressed section then the data would not be corupted (if that is the issue)
 
 
-// defrag function.
+// defrag function. (done see Compact)
 
 
 
-BStore::BStore(bool header, bool type_checking):m_version(1.0){
+BStore::BStore(bool header, bool type_checking):m_version(6.0){
   //  m_serialise=true;
   m_type_checking=type_checking;
   m_has_header=header;  
@@ -40,10 +81,40 @@ BStore::BStore(bool header, bool type_checking):m_version(1.0){
   
   //  m_current_loaded_entry=0;
   m_update=false;
+  m_file_version=m_version;
+  m_lazy=false;
+  m_column_rows=1024;
+  m_group_start=0;
+  m_group_data_start=0;
+  m_prefetch_depth=0;
+  m_prefetch_sequential=true;
+  m_last_entry=-1;
+  m_prefetcher=0;
+  m_journaled=false;
+  m_journal=0;
+  m_closed=false;
+  m_compact_ok=false;
+  m_compact_in_place=false;
+  m_compact_file_end=0;
+  m_compact_entries=0;
+  m_batch_entries=0;
+  m_batch_bytes=0;
+  m_generation=++generations;
+  m_names_written=0;
+  m_type_ids_generation=0;
+  m_in_memory=false;
+  m_ring_size=0;
+  m_ring_slots=0;
+  m_ring_slot_size=1048576;
+  m_ring_timeout=-1;
+  m_ring_writer=false;
+  m_ring_header_sequence=0;
+  m_codec=NO_CODEC;
+  m_codec_level=-1;
 
 }
 
-BStore::BStore(const BStore &bs):m_version(1.0){
+BStore::BStore(const BStore &bs):m_version(6.0){
 
    m_variables = bs.m_variables;
    m_type_info = bs.m_type_info;
@@ -54,6 +125,44 @@ BStore::BStore(const BStore &bs):m_version(1.0){
      Header = nullptr;
    
    m_lookup = bs.m_lookup;
+   m_directories = bs.m_directories;
+   m_directory = bs.m_directory;
+   m_lazy = bs.m_lazy;
+   m_column_rows = bs.m_column_rows;
+   m_pending = bs.m_pending;
+   m_columns = bs.m_columns;
+   m_group_start = bs.m_group_start;
+   m_group_data = bs.m_group_data;
+   m_group_data_start = bs.m_group_data_start;
+   m_prefetch_depth = bs.m_prefetch_depth;
+   m_prefetch_sequential = bs.m_prefetch_sequential;
+   m_last_entry = bs.m_last_entry;
+   m_prefetcher = 0;
+   m_journaled = bs.m_journaled;
+   m_journal = 0;
+   m_closed = false;
+   m_compact_ok = false;
+   m_compact_in_place = false;
+   m_compact_file_end = 0;
+   m_compact_entries = 0;
+   m_batch_entries = bs.m_batch_entries;
+   m_batch_bytes = bs.m_batch_bytes;
+   m_batch = bs.m_batch;
+   m_batch_records = bs.m_batch_records;
+   m_names = bs.m_names;
+   m_name_ids = bs.m_name_ids;
+   m_names_written = bs.m_names_written;
+   m_type_name_ids = bs.m_type_name_ids;
+   m_generation = ++generations;
+   m_type_ids_generation = 0;
+   m_in_memory = bs.m_in_memory;
+   m_ring_size = 0; // the copy doesnt take part in the ring
+   m_ring_slots = bs.m_ring_slots;
+   m_ring_slot_size = bs.m_ring_slot_size;
+   m_ring_timeout = bs.m_ring_timeout;
+   m_ring_writer = false;
+   m_ring_header_sequence = 0;
+   for(std::map<std::string,HeldValueBase*>::const_iterator it=bs.m_held.begin(); it!=bs.m_held.end(); ++it) m_held[it->first]=it->second->Clone();
    output = bs.output;
    m_file_end = bs.m_file_end;
    m_file_name = bs.m_file_name;
@@ -67,6 +176,9 @@ BStore::BStore(const BStore &bs):m_version(1.0){
    m_lookup_start = bs.m_lookup_start;
    m_update = bs.m_update;
    m_version = bs.m_version;
+   m_file_version = bs.m_file_version;
+   m_codec = bs.m_codec;
+   m_codec_level = bs.m_codec_level;
    
 }
 
@@ -78,28 +190,40 @@ std::string BStore::GetVersion(){
 
 }
 
-bool BStore::GetFlags(unsigned int file_end){
+bool BStore::GetFlags(unsigned long int file_end){
 
 
   m_file_end=file_end;       // not sure if i wnna keep thiese two here
   m_open_file_end=file_end;
   
-  if(!output.Bseek( file_end-(sizeof(m_version)+sizeof(m_header_start)+sizeof(m_has_header)+sizeof(m_lookup_start)+sizeof(m_type_checking)+sizeof(m_type)+sizeof(m_previous_file_end)), SEEK_SET)){
-    std::clog<<"ERROR BStore::GetFlags : Error seeking start of flags"<<std::endl;
-    return false;
-  }
-  //  std::cout<<"current pos-11="<<output.Btell()<<std::endl;
-  m_flags_start=output.Btell();
-  //std::cout<<"flast start pos="<<m_flags_start<<std::endl;
-  //std::cout<<"current pos5="<<output.Btell()<<std::endl;
+  // from version 2 the flags finish with the version and a magic number so the layout can be found from the end, version 1 flags start with the version
   float version=0;
-  if(!(output >> version)){
-    std::clog<<"ERROR BStore::GetFlags : Error reading version"<<std::endl;
-    return false;                                               
-  }  
-  if(version!=m_version) std::clog<<"Warning BStore::GetFlags : version missmatch m_version="<<m_version<<", file version="<<version<<". possibly incompatible"<<std::endl;
+  uint32_t magic=0;
+  if(file_end>=sizeof(version)+sizeof(magic) && output.Bseek(file_end-(sizeof(version)+sizeof(magic)), SEEK_SET) && (output >> version) && (output >> magic) && magic==BSTORE_FLAGS_MAGIC && version>=2){
+    if(file_end<FlagsSize(version) || !output.Bseek(file_end-FlagsSize(version), SEEK_SET)){
+      std::clog<<"ERROR BStore::GetFlags : Error seeking start of flags"<<std::endl;
+      return false;
+    }
+    m_flags_start=output.Btell();
+  }
+  else{
+    if(file_end<FlagsSize(1) || !output.Bseek(file_end-FlagsSize(1), SEEK_SET)){
+      std::clog<<"ERROR BStore::GetFlags : Error seeking start of flags"<<std::endl;
+      return false;
+    }
+    //  std::cout<<"current pos-11="<<output.Btell()<<std::endl;
+    m_flags_start=output.Btell();
+    //std::cout<<"flast start pos="<<m_flags_start<<std::endl;
+    //std::cout<<"current pos5="<<output.Btell()<<std::endl;
+    if(!(output >> version)){
+      std::clog<<"ERROR BStore::GetFlags : Error reading version"<<std::endl;
+      return false;                                               
+    }
+  }
+  if(version>m_version) std::clog<<"Warning BStore::GetFlags : version missmatch m_version="<<m_version<<", file version="<<version<<". possibly incompatible"<<std::endl;
+  m_file_version=version;
 
-  if(!(output >> m_header_start)){
+  if(!ReadOffset(m_header_start, version)){
     std::clog<<"ERROR BStore::GetFlags : Error reading m_header_start"<<std::endl;
     return false;                                               
   }
@@ -107,7 +231,7 @@ bool BStore::GetFlags(unsigned int file_end){
     std::clog<<"ERROR BStore::GetFlags : Error reading m_has_header"<<std::endl;
     return false;
   }
-  if(!(output >> m_lookup_start)){
+  if(!ReadOffset(m_lookup_start, version)){
     std::clog<<"ERROR BStore::GetFlags : Error reading m_lookup_start"<<std::endl; 
     return false;
   }
@@ -127,10 +251,17 @@ bool BStore::GetFlags(unsigned int file_end){
     return false; 
   }
   //std::cout<<"current pos="<<output.Btell()<<std::endl;
-  if(!(output >> m_previous_file_end)){
+  if(!ReadOffset(m_previous_file_end, version)){
     std::clog<<"ERROR BStore::GetFlags : Error reading m_precious_file_end"<<std::endl;
     return false;
   }
+  if(version>=2){
+    if(!(output >> m_codec)){
+      std::clog<<"ERROR BStore::GetFlags : Error reading m_codec"<<std::endl;
+      return false;
+    }
+  }
+  else m_codec= (m_type==uncompressed ? NO_CODEC : ZLIB_CODEC);
   //std::cout<<"current pos="<<output.Btell()<<std::endl;
   //std::cout<<"loading"<<std::endl;
   //std::cout<<"m_lookup_start="<< m_lookup_start<<std::endl;
@@ -143,12 +274,32 @@ bool BStore::GetFlags(unsigned int file_end){
   return true;
 }
 
-bool BStore::GetFlags(std::string filename, unsigned int file_end){
+unsigned int BStore::FlagsSize(float version){
+
+  unsigned int offset= version>=3 ? sizeof(uint64_t) : sizeof(uint32_t); // m_header_start, m_lookup_start and m_previous_file_end
+  unsigned int size=sizeof(m_version)+sizeof(m_has_header)+sizeof(m_type_checking)+sizeof(m_type)+3*offset;
+  if(version>=2) size+=sizeof(m_codec)+sizeof(uint32_t); // codec and magic number
+
+  return size;
+}
+
+bool BStore::ReadOffset(uint64_t& offset, float version){
+
+  if(version>=3) return output >> offset;
+  uint32_t tmp=0;
+  if(!(output >> tmp)) return false;
+  offset=tmp;
+  return true;
+
+}
+
+bool BStore::GetFlags(std::string filename, unsigned long int file_end){
   
-  if(!output.Bclose()){
+  if(!m_closed && !output.Bclose()){
     std::clog<<"ERROR BStore::GetFlags : Error closing any open file"<<std::endl;
     return false;
   }
+  m_closed=false;
   if(!output.Bopen(filename, READ, UNCOMPRESSED)){
     std::clog<<"ERROR BStore::GetFlags : Error opening file for flags"<<std::endl;
     return false;
@@ -185,17 +336,65 @@ bool BStore::GetFlags(std::string filename, unsigned int file_end){
 
 
 
-bool BStore::Initnew(std::string filename, enum_type type, bool header, bool type_checking, unsigned int file_end){
+bool BStore::Initnew(std::string filename, enum_type type, bool header, bool type_checking, unsigned long int file_end, enum_codec codec, int codec_level){
  m_file_name=filename; 
+ m_codec_level=codec_level;
+ output.m_codec_level=codec_level;
+ StopPrefetch();
+ JoinCompact();
+ CloseJournal(false);
+ m_batch.Reset(); // unflushed entries belonged to the previous file
+ m_batch_records.clear();
+ m_names.clear();
+ m_name_ids.clear();
+ m_names_written=0;
+ m_type_name_ids.clear();
+ m_generation=++generations; // type ids refer to the old dictionary
+ m_last_entry=-1;
+ m_columns.clear();
+ m_group_start=0;
+ m_group_data.clear();
+ m_indexes.clear();
+ if(m_ring && !CloseRing()) return false;
+ if(type==shared_memory) return OpenRing(filename, header, type_checking);
  
  struct stat buffer;   
-  if(stat (filename.c_str(), &buffer) == 0){ //if file exists    
+ std::vector<JournalRecord> journal;
+ uint64_t journal_base=0;
+ uint64_t journal_end=0;
+ bool recovering= stat((filename+".journal").c_str(), &buffer) == 0; // the file was not closed
+ if(recovering){
+   if(!ReadJournal(filename, journal_base, journal_end, header, type_checking, journal)){
+     std::clog<<"ERROR BStore::Initnew : Error reading journal of unclosed file "<<filename<<std::endl;
+     return false;
+   }
+   std::clog<<"Warning BStore::Initnew : "<<filename<<" was not closed, recovering "<<journal.size()<<" journal records"<<std::endl;
+   if(stat(filename.c_str(), &buffer) == 0 && truncate(filename.c_str(), static_cast<off_t>(journal_end))){ // drop any partly written entry
+     std::clog<<"ERROR BStore::Initnew : Error truncating unclosed file"<<std::endl;
+     return false;
+   }
+   file_end=journal_base; // last flags written by Close, if any
+   type=uncompressed;
+ }
+ 
+  if(stat (filename.c_str(), &buffer) == 0 && !(recovering && journal_base==0)){ //if file exists    
     //std::cout<<"file exists"<<std::endl;
     if(!GetFlags(filename, file_end)){ 
       std::clog<<"ERROR BStore::Initnew : Error in obtaining flags"<<std::endl;
       return false;
     }
-    if(m_type==uncompressed){
+    if(Codec::Get(m_codec)==0){
+      std::clog<<"ERROR BStore::Initnew : file compressed with codec "<<(int)m_codec<<" which is not available in this build"<<std::endl;
+      return false;
+    }
+    output.m_codec=m_codec;
+    if(m_type==uncompressed && type==uncompressed_mmap){
+      if(!output.Bopen(filename, READ, MMAP)){
+	std::clog<<"ERROR Bstore::Initnew : Error memory mapping uncompressed file"<<std::endl;
+	return false;
+      }
+    }
+    else if(m_type==uncompressed){
       if(!output.Bopen(filename, READ_APPEND, UNCOMPRESSED)){
 	std::clog<<"ERROR Bstore::Initnew : Error opening uncompressed file"<<std::endl;	
 	return false;
@@ -222,6 +421,17 @@ bool BStore::Initnew(std::string filename, enum_type type, bool header, bool typ
       m_open_file_end=output.Btell();
     }
 #endif
+    else if(m_type==block_compressed || m_type==columnar){
+      if(!output.Bopen(filename, READ_APPEND, BLOCK_COMPRESSED, m_flags_start)){ // flags are appended after the container
+	std::clog<<"ERROR BStore::Initnew : Error openning block_compressed file"<<std::endl;
+	return false;
+      }
+      if(!output.Bseek(0, SEEK_END)){
+	std::clog<<"ERROR BStore::Initnew : Error seeking end of file"<<std::endl;
+	return false;
+      }
+      m_file_end=output.Btell(); // m_open_file_end stays the physical end so rollback can find these flags
+    }
     else{
       std::clog<<"ERROR BStore::Initnew : unkown m_type"<<std::endl;
       return false;
@@ -231,8 +441,37 @@ bool BStore::Initnew(std::string filename, enum_type type, bool header, bool typ
       std::clog<<"ERROR BStore::Initnew : Error seeking m_lookup_start"<<std::endl; 
       return false;
     }
-    if(!(output >> m_lookup)){
-      std::clog<<"ERROR BStore::Initnew : Error retreiving lookup table"<<std::endl;
+    if(m_file_version>=3){
+      if(!(output >> m_lookup)){
+	std::clog<<"ERROR BStore::Initnew : Error retreiving lookup table"<<std::endl;
+	return false;
+      }
+    }
+    else{
+      std::vector<uint32_t> lookup;
+      if(!(output >> lookup)){
+	std::clog<<"ERROR BStore::Initnew : Error retreiving lookup table"<<std::endl;
+	return false;
+      }
+      m_lookup.assign(lookup.begin(), lookup.end());
+    }
+    if(m_file_version>=4){
+      if(!(output >> m_directories)){
+	std::clog<<"ERROR BStore::Initnew : Error retreiving directory lookup table"<<std::endl;
+	return false;
+      }
+    }
+    else m_directories.assign(m_lookup.size(), 0);
+    if(m_file_version>=5){
+      if(!(output >> m_names)){
+	std::clog<<"ERROR BStore::Initnew : Error retreiving type dictionary"<<std::endl;
+	return false;
+      }
+      for(uint32_t i=0; i<m_names.size(); i++) m_name_ids[m_names[i]]=i;
+      m_names_written=m_names.size();
+    }
+    if(m_file_version>=6 && !ReadIndexes()){
+      std::clog<<"ERROR BStore::Initnew : Error retreiving indexes"<<std::endl;
       return false;
     }
     if(!GetHeader()){
@@ -249,12 +488,21 @@ bool BStore::Initnew(std::string filename, enum_type type, bool header, bool typ
   else{ 
     //std::cout<<"file doesnt exist"<<std::endl;
     m_file_end=0;
+    if(type==block_compressed || type==columnar) m_codec=codec;
+    else if(type==compressed || type==post_pre_compress) m_codec=ZLIB_CODEC;
+    else m_codec=NO_CODEC;
+    if(Codec::Get(m_codec)==0){
+      std::clog<<"ERROR BStore::Initnew : codec "<<(int)m_codec<<" is not available in this build"<<std::endl;
+      return false;
+    }
+    output.m_codec=m_codec;
     //m_entry=0;
-    if(type==uncompressed){
+    if(type==uncompressed || type==uncompressed_mmap){
       if(!output.Bopen(filename, READ_APPEND, UNCOMPRESSED)){
 	std::clog<<"ERROR BStore::Initnew : Error openning new compressed file"<<std::endl;
 	return false;
       }
+      type=uncompressed;
     }
 #ifdef ZLIB
     else if(type==compressed){
@@ -270,6 +518,12 @@ bool BStore::Initnew(std::string filename, enum_type type, bool header, bool typ
       }
     }
 #endif
+    else if(type==block_compressed || type==columnar){
+      if(!output.Bopen(filename, READ_APPEND, BLOCK_COMPRESSED)){
+	std::clog<<"ERROR BStore::Initnew : Error openning new block_compressed file"<<std::endl;
+	return false;
+      }
+    }
     else{
       std::clog<<"ERROR BStore::Initnew : unknown new file type"<<std::endl;
       return false;
@@ -286,6 +540,40 @@ bool BStore::Initnew(std::string filename, enum_type type, bool header, bool typ
   }
   
   m_update=false;
+
+  if(recovering){
+    for(size_t i=0; i<journal.size(); i++){
+      if(!journal[i].length){
+	if(journal[i].entry<m_lookup.size()) m_lookup.erase(m_lookup.begin()+journal[i].entry);
+	if(journal[i].entry<m_directories.size()) m_directories.erase(m_directories.begin()+journal[i].entry);
+	continue;
+      }
+      if(journal[i].entry>=m_lookup.size()) m_lookup.resize(journal[i].entry+1);
+      m_directories.resize(m_lookup.size());
+      m_lookup[journal[i].entry]=journal[i].offset;
+      m_directories[journal[i].entry]=journal[i].directory;
+      uint64_t type_info_start=0;
+      if(m_type_checking && (!output.Bseek(journal[i].directory, SEEK_SET) || !(output >> type_info_start) || !output.Bseek(type_info_start, SEEK_SET) || !ReadTypeInfo(output))){ // the dictionary has grown in save order since the last close
+	std::clog<<"ERROR BStore::Initnew : Error recovering type dictionary"<<std::endl;
+	return false;
+      }
+    }
+    m_type_info.clear();
+    m_generation=++generations;
+    m_file_end=journal_end;
+    m_update=true; // so Close writes the recovered lookup
+    for(std::map<std::string,ValueIndex>::iterator it=m_indexes.begin(); it!=m_indexes.end(); ++it){ // the journal doesnt record index values
+      if(!FillIndex(it->first, it->second)){
+	std::clog<<"ERROR BStore::Initnew : Error recovering index of "<<it->first<<std::endl;
+	return false;
+      }
+    }
+  }
+  if((m_journaled || recovering) && !OpenJournal()){ // keep journaling the recovered entries until the file is closed
+    std::clog<<"ERROR BStore::Initnew : Error opening journal"<<std::endl;
+    return false;
+  }
+  m_closed=false;
   
   return true;  
 }
@@ -349,20 +637,52 @@ void BStore::Init2(){
 }
 
 */
+
+static uint32_t JournalChecksum(const char* data, uint64_t size){
+
+  uint32_t hash=2166136261U; // FNV-1a
+  for(uint64_t i=0; i<size; i++){
+    hash^=static_cast<unsigned char>(data[i]);
+    hash*=16777619U;
+  }
+  return hash;
+
+}
+
 bool BStore::Save(unsigned int entry){ //defualt save in next entry so need to do lookup size to find it, overlad with entry number so as to overwrite in lookup table.
   //std::cout<<"bob save start="<<output.Btell()<<std::endl;  
   //std::cout<<"save m_entry="<<m_entry<<std::endl;
 
   m_update=true;
+  StopPrefetch(); // entries now change under the reader
+  JoinCompact();
+  if(!LoadKeys()){
+    std::clog<<"ERROR BStore::Save : Error reading lazily loaded or serialising held keys"<<std::endl;
+    return false;
+  }
   
   //  std::cout<<"debug1 entry="<<entry<<std::endl;
 
   //  entry++;
   //std::cout<<"m_lookup.size()="<<m_lookup.size()<<std::endl;
+  if(m_type==shared_memory) return SaveRing();
   if(entry>=m_lookup.size()){
     entry=m_lookup.size();
     m_lookup.resize(m_lookup.size()+1); 
   }
+  if(!m_indexes.empty()) UpdateIndexes(entry);
+  
+  if(m_type==columnar){ // held until its group is full
+    m_lookup.at(entry)=0;
+    m_directories.resize(m_lookup.size());
+    ColumnRow row;
+    row.entry=entry;
+    row.variables=m_variables;
+    if(m_type_checking) row.type_info=m_type_info;
+    m_pending.push_back(row);
+    if(m_pending.size()>=m_column_rows) return FlushColumns();
+    return true;
+  }
   //std::cout<<"debug2 entry="<<entry<<std::endl;
   
   
@@ -370,6 +690,21 @@ bool BStore::Save(unsigned int entry){ //defualt save in next entry so need to d
   
   //std::cout<<"save start2="<<output.Btell()<<std::endl;
   //std::cout<<"m_file_end="<<m_file_end<<std::endl;
+  m_directories.resize(m_lookup.size());
+
+  if(m_batch_entries){ // serialised now, written with the rest of the batch
+    JournalRecord record;
+    record.entry=entry;
+    record.offset=m_file_end+m_batch.Btell();
+    record.checksum=0;
+    m_lookup.at(entry)=record.offset;
+    if(!WriteEntry(m_batch, m_file_end, m_directories.at(entry))) return false;
+    record.length=m_file_end+m_batch.Btell()-record.offset;
+    record.directory=m_directories.at(entry);
+    m_batch_records.push_back(record);
+    if(m_batch_records.size()>=m_batch_entries || m_batch.Btell()>=m_batch_bytes) return FlushBatch();
+    return true;
+  }
  
   if(!output.Bseek(m_file_end,SEEK_SET)){
     std::clog<<"ERROR BStore::Save : Error seeking end of file"<<std::endl;  
@@ -377,28 +712,227 @@ bool BStore::Save(unsigned int entry){ //defualt save in next entry so need to d
   }
   //std::cout<<"save entry2="<<entry<<std::endl;
   m_lookup.at(entry)=output.Btell();
+  if(m_journal){ // serialised in memory first so the record's checksum comes from the bytes being written
+    m_journal_entry.Reset();
+    if(!WriteEntry(m_journal_entry, m_file_end, m_directories.at(entry))) return false;
+    if(!output.Bwrite(m_journal_entry.buffer.data(), m_journal_entry.buffer.length())){
+      std::clog<<"ERROR BStore::Save : Error writing entry"<<std::endl;
+      return false;
+    }
+    m_file_end=output.Btell();
+    if(!WriteJournal(entry, m_lookup[entry], m_journal_entry.buffer.length(), m_directories[entry], JournalChecksum(m_journal_entry.buffer.data(), m_journal_entry.buffer.length()))){
+      std::clog<<"ERROR BStore::Save : Error writing journal"<<std::endl;
+      return false;
+    }
+    return true;
+  }
+  if(!WriteEntry(output, 0, m_directories.at(entry))) return false;
+  m_file_end=output.Btell(); 
+  
+  
+  return true;
+}
+
+bool BStore::WriteEntry(BinaryStream& stream, uint64_t base, uint64_t& directory_start){
+
   //std::cout<<"m_variables.size()="<<m_variables.size()<<std::endl;
   //std::cout<<"m_lookup.size()="<<m_lookup.size()<<std::endl;
   //std::cout<<"before saving m_variables="<<output.Btell()<<std::endl;
-  if(!(output << m_variables)){
+  // same layout as stream << m_variables but noting where each value lands for the key directory
+  std::map<std::string,KeyLocation> directory;
+  uint64_t size=m_variables.size();
+  if(!stream.WriteSize(size)){
     std::clog<<"ERROR BStore::Save : Error writing m_varaibles"<<std::endl;
     return false;
   }
+  for(std::map<std::string,BinaryStream>::iterator it=m_variables.begin(); it!=m_variables.end(); ++it){
+    KeyLocation& location=directory[it->first];
+    location.size=it->second.buffer.length();
+    if(!(stream << it->first) || !stream.WriteSize(location.size)){
+      std::clog<<"ERROR BStore::Save : Error writing m_varaibles"<<std::endl;
+      return false;
+    }
+    location.offset=base+stream.Btell();
+    if(location.size && !stream.Bwrite(it->second.buffer.data(), location.size)){
+      std::clog<<"ERROR BStore::Save : Error writing m_varaibles"<<std::endl;
+      return false;
+    }
+  }
   //std::cout<<"after saving m_variables="<<output.Btell()<<std::endl;
+  uint64_t type_info_start=0;
   if(m_type_checking){
-    if(!(output << m_type_info)){
+    type_info_start=base+stream.Btell();
+    if(!WriteTypeInfo(stream)){
       std::clog<<"ERROR BStore::Save : Error writing m_type_info"<<std::endl;
       return false;
     }
   }
-  m_file_end=output.Btell(); 
-  
+  directory_start=base+stream.Btell();
+  if(!(stream << type_info_start) || !(stream << directory)){
+    std::clog<<"ERROR BStore::Save : Error writing key directory"<<std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool BStore::Resolve(KeyHandle& key, bool create){
+
+  if(key.store==this && key.generation==m_generation) return true;
+
+  std::map<std::string,BinaryStream>::iterator it=m_variables.find(key.name);
+  if(it==m_variables.end()){
+    if(create) it=m_variables.insert(std::make_pair(key.name, BinaryStream())).first;
+    else if(LazyLoad(key.name)) it=m_variables.find(key.name);
+    else return false;
+  }
+  key.value=it;
+  key.type=m_type_info.find(key.name);
+  SyncTypeIds();
+  key.type_id=m_type_ids.find(key.name);
+  key.store=this;
+  key.generation=m_generation;
+
+  return true;
+}
+
+uint32_t BStore::TypeId(const std::type_info& type){
+
+  std::unordered_map<const std::type_info*,uint32_t>::iterator it=m_type_name_ids.find(&type);
+  if(it!=m_type_name_ids.end()) return it->second;
+  uint32_t id=NameId(type.name());
+  m_type_name_ids[&type]=id;
+
+  return id;
+}
+
+void BStore::SyncTypeIds(){
+
+  if(m_type_ids_generation==m_generation) return;
+  m_type_ids.clear();
+  m_type_ids_generation=m_generation;
+
+}
+
+std::map<std::string,uint32_t>::iterator BStore::FindTypeId(const std::string& name){
+
+  SyncTypeIds();
+  std::map<std::string,uint32_t>::iterator it=m_type_ids.lower_bound(name);
+  if(it!=m_type_ids.end() && it->first==name) return it;
+  std::map<std::string,std::string>::iterator type=m_type_info.find(name);
+  if(type==m_type_info.end()) return m_type_ids.end();
+
+  return m_type_ids.insert(it, std::make_pair(name, NameId(type->second)));
+}
+
+bool BStore::CheckType(const std::string& name, const std::type_info& type){
+
+  std::map<std::string,uint32_t>::iterator it=FindTypeId(name);
+  return it!=m_type_ids.end() && it->second==TypeId(type);
+
+}
+
+bool BStore::CheckType(KeyHandle& key, const std::type_info& type){
+
+  if(key.type_id==m_type_ids.end()) key.type_id=FindTypeId(key.name); // may have been set by name since
+  return key.type_id!=m_type_ids.end() && key.type_id->second==TypeId(type);
+
+}
+
+void BStore::SetType(const std::string& name, const std::type_info& type){
+
+  uint32_t id=TypeId(type);
+  SyncTypeIds();
+  std::map<std::string,uint32_t>::iterator it=m_type_ids.lower_bound(name);
+  if(it!=m_type_ids.end() && it->first==name){
+    if(it->second==id) return; // m_type_info already names the type
+    it->second=id;
+  }
+  else m_type_ids.insert(it, std::make_pair(name, id));
+  m_type_info[name]=type.name();
+
+}
+
+void BStore::SetType(KeyHandle& key, const std::type_info& type){
+
+  uint32_t id=TypeId(type);
+  if(key.type_id!=m_type_ids.end() && key.type_id->second==id) return; // m_type_info already names the type
+  if(key.type_id==m_type_ids.end()) key.type_id=m_type_ids.insert(std::make_pair(key.name, id)).first;
+  key.type_id->second=id;
+  if(key.type==m_type_info.end()) key.type=m_type_info.insert(std::make_pair(key.name, std::string())).first;
+  key.type->second=type.name();
+
+}
+
+uint32_t BStore::NameId(const std::string& name){
+
+  std::unordered_map<std::string,uint32_t>::iterator it=m_name_ids.find(name);
+  if(it!=m_name_ids.end()) return it->second;
+  m_names.push_back(name);
+  m_name_ids[name]=m_names.size()-1;
+  return m_names.size()-1;
+
+}
+
+bool BStore::WriteTypeInfo(BinaryStream& stream){
+
+  if(m_type==shared_memory) return stream << m_type_info; // ring entries are read without the ones before them so cant rely on a dictionary
+
+  uint32_t marker=TYPE_DICTIONARY_MARKER;
+  uint32_t first=m_names_written; // names added since, by this entry or by type checks, are written with it
+  std::vector<uint32_t> ids;
+  ids.reserve(m_type_info.size()*2);
+  for(std::map<std::string,std::string>::iterator it=m_type_info.begin(); it!=m_type_info.end(); ++it){
+    ids.push_back(NameId(it->first));
+    ids.push_back(NameId(it->second));
+  }
+  std::vector<std::string> added(m_names.begin()+first, m_names.end()); // lets the dictionary be rebuilt from the entries if the file isnt closed
+  m_names_written=m_names.size();
+
+  return (stream << marker) && (stream << first) && (stream << added) && (stream << ids);
+}
+
+bool BStore::ReadTypeInfo(BinaryStream& stream){
+
+  uint32_t known=m_names.size();
+  m_generation=++generations; // m_type_info is replaced
+  m_type_ids.clear();
+  m_type_ids_generation=m_generation;
+  if(!ToolFramework::ReadTypeInfo(stream, m_type_info, m_names, &m_names, &m_type_ids)) return false;
+  for(uint32_t i=known; i<m_names.size(); i++) m_name_ids[m_names[i]]=i;
+  if(m_names_written==known) m_names_written=m_names.size(); // names added by the entry are already in the file
+
+  return true;
+
+}
+
+bool BStore::FlushBatch(){
+
+  if(m_batch_records.empty()) return true;
   
+  if(!output.Bseek(m_file_end,SEEK_SET) || !output.Bwrite(m_batch.buffer.data(), m_batch.buffer.length())){
+    std::clog<<"ERROR BStore::FlushBatch : Error writing batched entries"<<std::endl;
+    return false;
+  }
+  m_file_end=output.Btell();
+  if(m_journal){
+    for(size_t i=0; i<m_batch_records.size(); i++){
+      const JournalRecord& record=m_batch_records[i];
+      if(!WriteJournal(record.entry, record.offset, record.length, record.directory, JournalChecksum(m_batch.buffer.data()+(record.offset-m_batch_records[0].offset), record.length), i+1==m_batch_records.size())){
+	std::clog<<"ERROR BStore::FlushBatch : Error writing journal"<<std::endl;
+	return false;
+      }
+    }
+  }
+  m_batch.Reset();
+  m_batch_records.clear();
+
   return true;
 }
 
 bool BStore::GetHeader(){
   
+  if(m_type==shared_memory) return GetRingHeader();
   if(m_has_header){
     if(Header!=0){
       delete Header;
@@ -424,7 +958,7 @@ bool BStore::GetEntry(unsigned int entry_request){
 
   //if(!entry_request) return false;  
   //std::cout<<"passed non zero check"<<std::endl;
-  if((m_lookup.size()-1)<entry_request){
+  if(m_type!=shared_memory && (m_lookup.size()-1)<entry_request){
     std::clog<<"ERROR BStore::GetEntry : Entry outside of range"<<std::endl;
     return false;
   } 
@@ -433,9 +967,69 @@ bool BStore::GetEntry(unsigned int entry_request){
   //std::cout<<"passed get entry checks"<<std::endl;
 
   Delete();
+  if(!FlushBatch()){
+    std::clog<<"ERROR BStore::GetEntry : Error writing batched entries"<<std::endl;
+    return false;
+  }
+  uint64_t position=0;
+  uint64_t directory=0;
+  if(m_type==shared_memory){
+    if(!GetRingEntry(entry_request, directory)) return false;
+  }
+  else{
+    position=m_lookup[entry_request];
+    if(entry_request<m_directories.size()) directory=m_directories[entry_request];
+  }
+  if(m_type==columnar){
+    if(!m_lookup[entry_request] && !FlushColumns()){ // still waiting to be written
+      std::clog<<"ERROR BStore::GetEntry : Error writing pending columnar entries"<<std::endl;
+      return false;
+    }
+    if(m_lookup[entry_request]!=m_group_start && !LoadGroup(m_lookup[entry_request])){
+      std::clog<<"ERROR BStore::GetEntry : Error reading columnar group"<<std::endl;
+      return false;
+    }
+    if(!m_lazy && m_group_data.empty() && !LoadGroupData()){
+      std::clog<<"ERROR BStore::GetEntry : Error reading columnar group values"<<std::endl;
+      return false;
+    }
+    uint64_t row= entry_request<m_directories.size() ? m_directories[entry_request] : 0;
+    for(std::map<std::string,ColumnChunk>::iterator it=m_columns.begin(); it!=m_columns.end(); ++it){
+      if(row>=it->second.sizes.size() || it->second.sizes[row]==COLUMN_MISSING) continue;
+      m_directory[it->first].offset=it->second.offsets[row];
+      m_directory[it->first].size=it->second.sizes[row];
+      if(it->second.types.size()){
+        const std::string& type= it->second.types.size()==1 ? it->second.types[0] : it->second.types[row];
+        m_type_info[it->first]=type;
+        std::map<std::string,uint32_t>::iterator id=m_type_ids.find(it->first);
+        if(id!=m_type_ids.end()) id->second=NameId(type); // keeps cached handles in step with the row
+      }
+    }
+    return m_lazy || LoadKeys();
+  }
+  if(m_prefetch_depth && !m_lazy && !m_update && m_type!=ram && m_type!=shared_memory){
+    if(m_prefetcher && TakePrefetched(entry_request)){
+      m_last_entry=entry_request;
+      return true;
+    }
+    if(!m_prefetcher && (!m_prefetch_sequential || entry_request==m_last_entry+1)) StartPrefetch(entry_request+1);
+  }
+  m_last_entry=entry_request;
+  if(m_lazy && directory){
+    uint64_t type_info_start=0;
+    if(!output.Bseek(directory, SEEK_SET) || !(output >> type_info_start) || !(output >> m_directory)){
+      std::clog<<"ERROR BStore::GetEntry : Error reading key directory"<<std::endl;
+      return false;
+    }
+    if(m_type_checking && (!output.Bseek(type_info_start, SEEK_SET) || !ReadTypeInfo(output))){
+      std::clog<<"ERROR BStore::GetEntry : Error reteriving m_type_info"<<std::endl;
+      return false;
+    }
+    return true;
+  }
   //std::cout<<"getting entry data: entry="<<entry_request<<", location is="<<m_lookup[entry_request]<<std::endl;  
   //std::cout<<"mode="<<output.m_mode<<std::endl;
-  if(!output.Bseek(m_lookup[entry_request], SEEK_SET)){
+  if(!output.Bseek(position, SEEK_SET)){
     std::clog<<"ERROR BStore::GetEntry : Error seeking entry"<<std::endl;  
     return false;
   }
@@ -446,7 +1040,7 @@ bool BStore::GetEntry(unsigned int entry_request){
   }
   //std::cout<<"mode="<<output.m_mode<<std::endl;
   if(m_type_checking){
-    if(!(output >>  m_type_info)){
+    if(!ReadTypeInfo(output)){
       std::clog<<"ERROR BStore::GetEntry : Error reteriving m_type_info"<<std::endl;
       return false;
     }
@@ -461,7 +1055,7 @@ bool BStore::GetEntry(unsigned int entry_request){
 bool BStore::WriteHeader(){
   
   m_header_start=output.Btell();
-  if(m_has_header>0 && !(output << Header->m_variables)){
+  if(m_has_header>0 && !(Header->Materialise() && output << Header->m_variables)){
     std::clog<<"ERROR BStore::WriteHeader : Entry saving Header varaibles"<<std::endl;
     return false;
   }  m_file_end=output.Btell();
@@ -479,6 +1073,19 @@ bool BStore::WriteLookup(){
     std::clog<<"ERROR BStore::WriteLookup : Error saving lookup table"<<std::endl;
     return false;
   }
+  m_directories.resize(m_lookup.size());
+  if(!(output << m_directories)){
+    std::clog<<"ERROR BStore::WriteLookup : Error saving directory lookup table"<<std::endl;
+    return false;
+  }
+  if(!(output << m_names)){
+    std::clog<<"ERROR BStore::WriteLookup : Error saving type dictionary"<<std::endl;
+    return false;
+  }
+  if(!WriteIndexes()){
+    std::clog<<"ERROR BStore::WriteLookup : Error saving indexes"<<std::endl;
+    return false;
+  }
   m_file_end=output.Btell();
 
   return true;
@@ -486,10 +1093,6 @@ bool BStore::WriteLookup(){
 
 bool BStore::WriteFlags(){
 
-  if(!(output << m_version)){
-    std::clog<<"ERROR BStore::WriteFlags : Error writing m_version"<<std::endl;
-    return false;
-  }
   if(!(output << m_header_start)){
     std::clog<<"ERROR BStore::WriteFlags : Error writing m_header_start"<<std::endl;
     return false;
@@ -518,13 +1121,36 @@ bool BStore::WriteFlags(){
     std::clog<<"ERROR BStore::WriteFlags : Error writing m_previous_file_end"<<std::endl;
     return false;
   }
+  if(!(output << m_codec)){
+    std::clog<<"ERROR BStore::WriteFlags : Error writing m_codec"<<std::endl;
+    return false;
+  }
+  if(!(output << m_version)){
+    std::clog<<"ERROR BStore::WriteFlags : Error writing m_version"<<std::endl;
+    return false;
+  }
+  uint32_t magic=BSTORE_FLAGS_MAGIC;
+  if(!(output << magic)){
+    std::clog<<"ERROR BStore::WriteFlags : Error writing magic number"<<std::endl;
+    return false;
+  }
   return true;
 
 }
 
 bool BStore::Close(){
   
-  if(!m_update) return output.Bclose(true);
+  StopPrefetch();
+  JoinCompact();
+  if(m_type==shared_memory) return CloseRing();
+  
+  if(m_closed) return true;
+  if(!m_update){
+    if(!output.Bclose(true)) return false;
+    CloseJournal(true);
+    m_closed=true;
+    return true;
+  }
   else{
 
     //std::cout<<"in close"<<std::endl;
@@ -532,6 +1158,10 @@ bool BStore::Close(){
     //std::cout<<"m_file_end"<<m_file_end<<std::endl;
     //   std::cout<<"s1"<<std::endl;
     // write header and lookup
+    if(!FlushColumns() || !FlushBatch()){
+      std::clog<<"ERROR BStore::Close : Error writing pending entries"<<std::endl;
+      return false;
+    }
     if(!output.Bseek(m_file_end,SEEK_SET)){
       std::clog<<"ERROR BStore::Close : Error seeking m_file_end"<<std::endl;
       return false;
@@ -611,6 +1241,8 @@ bool BStore::Close(){
       std::clog<<"ERROR BStore::Close : Error closing file after writing flags"<<std::endl;
       return false;
     }    
+    CloseJournal(true);
+    m_closed=true;
     //std::cout<<"s10"<<std::endl;
     //std::cout<<"k5"<<std::endl;
     Delete();    
@@ -631,6 +1263,8 @@ bool BStore::Print(){
 
 void BStore::Print(bool values){
   
+  LoadKeys();
+  
   for (std::map<std::string,BinaryStream>::iterator it=m_variables.begin(); it!=m_variables.end(); ++it){
     
     std::cout<< it->first << " => ";
@@ -652,8 +1286,10 @@ void BStore::Print(bool values){
 
 void BStore::Delete(){ 
   
+  m_generation=++generations;
   m_variables.clear();
   m_type_info.clear();
+  m_directory.clear();
  
   for (std::map<std::string,PointerWrapperBase*>::iterator it=m_ptrs.begin(); it!=m_ptrs.end(); ++it){
 
@@ -663,11 +1299,17 @@ void BStore::Delete(){
   }
   m_ptrs.clear();
   
+  for (std::map<std::string,HeldValueBase*>::iterator it=m_held.begin(); it!=m_held.end(); ++it) delete it->second;
+  m_held.clear();
   
 }
 
 
-void BStore::Remove(std::string key){
+void BStore::Remove(const std::string& key){
+
+  m_generation=++generations;
+  m_directory.erase(key);
+  Release(key);
 
   for (std::map<std::string,BinaryStream>::iterator it=m_variables.begin(); it!=m_variables.end(); ++it){
 
@@ -749,8 +1391,13 @@ void BStore::JsonParser(std::string input){
 }
 
 
-std::string BStore::Type(std::string key){
+std::string BStore::Type(const std::string& key){
 
+  std::map<std::string,HeldValueBase*>::iterator held=m_held.find(key);
+  if(held!=m_held.end()){
+    if(m_type_checking) return held->second->Type().name();
+    else return "?";
+  }
   if(m_type_info.count(key)>0){
     if(m_type_checking) return m_type_info[key];
     else return "?";
@@ -759,9 +1406,9 @@ std::string BStore::Type(std::string key){
 
 }
 
-bool BStore::Has(std::string key){
+bool BStore::Has(const std::string& key){
 
-  if(m_variables.count(key)>0) return true;
+  if(m_variables.count(key)>0 || m_directory.count(key)>0 || m_held.count(key)>0) return true;
   else return false;
 
 }
@@ -772,7 +1419,25 @@ bool BStore::DeleteEntry(unsigned int entry_request){
     std::clog<<"ERROR BStore::DeleteEntry : Error entry "<<entry_request<<" not in BStore"<<std::endl;
     return false;
   }  
+  StopPrefetch();
+  JoinCompact();
+  if(!FlushColumns()){ // pending columnar entries are numbered before the erase
+    std::clog<<"ERROR BStore::DeleteEntry : Error writing columnar entries"<<std::endl;
+    return false;
+  }
   m_lookup.erase(m_lookup.begin()+entry_request);
+  if(entry_request<m_directories.size()) m_directories.erase(m_directories.begin()+entry_request);
+  for(std::map<std::string,ValueIndex>::iterator it=m_indexes.begin(); it!=m_indexes.end(); ++it){
+    if(entry_request<it->second.values.size()){
+      it->second.values.erase(it->second.values.begin()+entry_request);
+      it->second.present.erase(it->second.present.begin()+entry_request);
+    }
+    it->second.sorted=false;
+  }
+  if(m_journal && !WriteJournal(entry_request, 0, 0, 0, 0)){
+    std::clog<<"ERROR BStore::DeleteEntry : Error writing journal"<<std::endl;
+    return false;
+  }
   
   m_update=true;
   
@@ -789,8 +1454,10 @@ bool BStore::Rollback(){
   }
   Delete();
   m_lookup.clear();
+  m_directories.clear();
+  CloseJournal(true); // the journaled saves are being discarded
 
-  Initnew(m_file_name, m_type, m_has_header, m_type_checking, m_previous_file_end);    // is this better than just reloading lookup and headers etc?
+  Initnew(m_file_name, m_type, m_has_header, m_type_checking, m_previous_file_end, m_codec, m_codec_level);    // is this better than just reloading lookup and headers etc?
 
   return true;
 }
@@ -801,11 +1468,42 @@ bool BStore::Serialise(BinaryStream &bs){ // do return properly
 
   ///neive new testing
 
+  if(bs.m_write){
+    LoadKeys();
+    FlushBatch();
+  }
+  else{ // held values would hide the ones read
+    for (std::map<std::string,HeldValueBase*>::iterator it=m_held.begin(); it!=m_held.end(); ++it) delete it->second;
+    m_held.clear();
+  }
   bs & output;
-  bs & m_lookup;
+  // nested stores keep 32 bit lookups so previously serialised stores still read. Offsets past 4GB are written as a single UINT32_MAX marker followed by the full 64 bit lookup (a single entry can never start that far in)
+  if(bs.m_write){
+    bool wide=false;
+    for(size_t i=0; i<m_lookup.size(); i++) wide|= (m_lookup[i] > UINT32_MAX);
+    if(!wide){
+      std::vector<uint32_t> lookup(m_lookup.size());
+      for(size_t i=0; i<m_lookup.size(); i++) lookup[i]=static_cast<uint32_t>(m_lookup[i]);
+      if(!(bs & lookup)) return false;
+    }
+    else{
+      std::vector<uint32_t> marker(1, UINT32_MAX);
+      if(!(bs & marker)) return false;
+      if(!(bs & m_lookup)) return false;
+    }
+  }
+  else{
+    std::vector<uint32_t> lookup;
+    if(!(bs & lookup)) return false;
+    if(lookup.size()==1 && lookup[0]==UINT32_MAX){
+      if(!(bs & m_lookup)) return false;
+    }
+    else m_lookup.assign(lookup.begin(), lookup.end());
+  }
   bs & m_variables;
   bs & m_type_checking;
   if (m_type_checking) bs & m_type_info;
+  if(!bs.m_write) m_generation=++generations; // m_variables and m_type_info were replaced
 
   /*
   save;
@@ -940,13 +1638,1057 @@ bool BStore::Serialise(BinaryStream &bs){ // do return properly
   }
 
 
-unsigned int BStore::NumEntries(){
-  
-  return m_lookup.size();
-  
-}
+bool BStore::LazyLoad(const std::string& name){
 
-BStore::~BStore(){
+  std::map<std::string,KeyLocation>::iterator it=m_directory.find(name);
+  if(it==m_directory.end()) return false;
+
+  BinaryStream& stream=m_variables[name];
+  stream.Reset();
+  bool ret=true;
+  if(it->second.offset>=m_group_data_start && it->second.offset+it->second.size<=m_group_data_start+m_group_data.length()) stream.buffer.assign(m_group_data, it->second.offset-m_group_data_start, it->second.size);
+  else{
+    stream.buffer.resize(it->second.size);
+    ret= output.Bseek(it->second.offset, SEEK_SET) && (!it->second.size || output.Bread(&(stream.buffer[0]), it->second.size));
+  }
+  m_directory.erase(it);
+  if(!ret){
+    m_variables.erase(name);
+    std::clog<<"ERROR BStore::LazyLoad : Error reading key "<<name<<std::endl;
+  }
+
+  return ret;
+}
+
+bool BStore::LoadKeys(){
+
+  bool ret=Materialise();
+  while(m_directory.size()) ret= LazyLoad(m_directory.begin()->first) && ret;
+
+  return ret;
+}
+
+bool BStore::Materialise(){
+  
+  bool ret=true;
+  for (std::map<std::string,HeldValueBase*>::iterator it=m_held.begin(); it!=m_held.end(); ++it) ret= Materialise(it) && ret;
+  
+  return ret;
+}
+
+bool BStore::Materialise(std::map<std::string,HeldValueBase*>::iterator held){
+  
+  if(!held->second->dirty) return true;
+  if(!held->second->Serialise(m_variables[held->first])){
+    std::clog<<"ERROR BStore::Materialise : Error serialising key "<<held->first<<std::endl;
+    return false;
+  }
+  if(m_type_checking) SetType(held->first, held->second->Type());
+  held->second->dirty=false;
+  
+  return true;
+}
+
+void BStore::Release(const std::string& name){
+  
+  std::map<std::string,HeldValueBase*>::iterator it=m_held.find(name);
+  if(it==m_held.end()) return;
+  delete it->second;
+  m_held.erase(it);
+  
+}
+
+bool BStore::FlushColumns(){
+
+  if(m_pending.empty()) return true;
+
+  if(!output.Bseek(m_file_end,SEEK_SET)){
+    std::clog<<"ERROR BStore::FlushColumns : Error seeking end of file"<<std::endl;
+    return false;
+  }
+
+  std::set<std::string> keys;
+  for(size_t i=0; i<m_pending.size(); i++){
+    for(std::map<std::string,BinaryStream>::iterator it=m_pending[i].variables.begin(); it!=m_pending[i].variables.end(); ++it) keys.insert(it->first);
+  }
+
+  std::map<std::string,uint64_t> chunks;
+  for(std::set<std::string>::iterator key=keys.begin(); key!=keys.end(); ++key){
+    std::vector<uint64_t> sizes(m_pending.size(), COLUMN_MISSING);
+    std::vector<std::string> types;
+    std::string type;
+    bool same_type=true;
+    for(size_t i=0; i<m_pending.size(); i++){
+      std::map<std::string,BinaryStream>::iterator value=m_pending[i].variables.find(*key);
+      if(value==m_pending[i].variables.end()) continue;
+      sizes[i]=value->second.buffer.length();
+      if(m_type_checking){
+	std::string& row_type=m_pending[i].type_info[*key];
+	if(type.empty()) type=row_type;
+	else if(row_type!=type) same_type=false;
+      }
+    }
+    if(m_type_checking){
+      if(same_type) types.push_back(type);
+      else for(size_t i=0; i<m_pending.size(); i++) types.push_back(m_pending[i].type_info[*key]);
+    }
+    chunks[*key]=output.Btell();
+    if(!(output << sizes) || !(output << types)){
+      std::clog<<"ERROR BStore::FlushColumns : Error writing column header for "<<*key<<std::endl;
+      return false;
+    }
+    for(size_t i=0; i<m_pending.size(); i++){
+      if(sizes[i]==COLUMN_MISSING || !sizes[i]) continue;
+      if(!output.Bwrite(m_pending[i].variables[*key].buffer.data(), sizes[i])){
+	std::clog<<"ERROR BStore::FlushColumns : Error writing column "<<*key<<std::endl;
+	return false;
+      }
+    }
+  }
+
+  uint64_t group_start=output.Btell();
+  if(!(output << chunks)){
+    std::clog<<"ERROR BStore::FlushColumns : Error writing group directory"<<std::endl;
+    return false;
+  }
+  m_file_end=output.Btell();
+
+  for(size_t i=0; i<m_pending.size(); i++){
+    m_lookup.at(m_pending[i].entry)=group_start;
+    m_directories.at(m_pending[i].entry)=i;
+  }
+  m_pending.clear();
+
+  return true;
+}
+
+bool BStore::LoadGroup(uint64_t group_start){
+
+  m_columns.clear();
+  m_group_start=0;
+  m_group_data.clear();
+
+  std::map<std::string,uint64_t> chunks;
+  if(!output.Bseek(group_start, SEEK_SET) || !(output >> chunks)) return false;
+
+  for(std::map<std::string,uint64_t>::iterator it=chunks.begin(); it!=chunks.end(); ++it){
+    ColumnChunk& chunk=m_columns[it->first];
+    if(!output.Bseek(it->second, SEEK_SET) || !(output >> chunk.sizes) || !(output >> chunk.types)) return false;
+    chunk.offsets.resize(chunk.sizes.size()+1);
+    chunk.offsets[0]=output.Btell();
+    for(size_t i=0; i<chunk.sizes.size(); i++) chunk.offsets[i+1]= chunk.offsets[i] + (chunk.sizes[i]==COLUMN_MISSING ? 0 : chunk.sizes[i]);
+  }
+  m_group_start=group_start;
+
+  return true;
+}
+
+bool BStore::LoadGroupData(){
+
+  uint64_t start=m_group_start;
+  uint64_t end=0;
+  for(std::map<std::string,ColumnChunk>::iterator it=m_columns.begin(); it!=m_columns.end(); ++it){
+    if(it->second.offsets.front()<start) start=it->second.offsets.front();
+    if(it->second.offsets.back()>end) end=it->second.offsets.back();
+  }
+  if(end<=start) return true;
+
+  m_group_data_start=start;
+  m_group_data.resize(end-start);
+  if(!output.Bseek(start, SEEK_SET) || !output.Bread(&(m_group_data[0]), m_group_data.length())){
+    m_group_data.clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool BStore::ReadColumn(const std::string& name, std::string& data, std::vector<uint64_t>& sizes, std::vector<std::string>& types){
+
+  data.clear();
+  sizes.clear();
+  types.clear();
+
+  if(m_type!=columnar){ // read the key from each entry through its key directory, into temporaries so the loaded entry is left as it is
+    if(!FlushBatch()){
+      std::clog<<"ERROR BStore::ReadColumn : Error writing batched entries"<<std::endl;
+      return false;
+    }
+    for(unsigned int i=0; i<m_lookup.size(); i++){
+      uint64_t directory= i<m_directories.size() ? m_directories[i] : 0;
+      std::map<std::string,std::string> type_info;
+      std::string value;
+      bool found=false;
+      if(directory){
+	uint64_t type_info_start=0;
+	std::map<std::string,KeyLocation> keys;
+	if(!output.Bseek(directory, SEEK_SET) || !(output >> type_info_start) || !(output >> keys)){
+	  std::clog<<"ERROR BStore::ReadColumn : Error reading key directory"<<std::endl;
+	  return false;
+	}
+	std::map<std::string,KeyLocation>::iterator it=keys.find(name);
+	if(it!=keys.end()){
+	  found=true;
+	  value.resize(it->second.size);
+	  if(!output.Bseek(it->second.offset, SEEK_SET) || (value.length() && !output.Bread(&(value[0]), value.length()))){
+	    std::clog<<"ERROR BStore::ReadColumn : Error reading key "<<name<<std::endl;
+	    return false;
+	  }
+	}
+	if(found && m_type_checking && !output.Bseek(type_info_start, SEEK_SET)){
+	  std::clog<<"ERROR BStore::ReadColumn : Error seeking type info"<<std::endl;
+	  return false;
+	}
+      }
+      else{ // entries saved before key directories are read whole
+	std::map<std::string,BinaryStream> variables;
+	if(!output.Bseek(m_lookup[i], SEEK_SET) || !(output >> variables)){
+	  std::clog<<"ERROR BStore::ReadColumn : Error reading entry"<<std::endl;
+	  return false;
+	}
+	std::map<std::string,BinaryStream>::iterator it=variables.find(name);
+	if(it!=variables.end()){
+	  found=true;
+	  value.swap(it->second.buffer);
+	}
+      }
+      if(found && m_type_checking && !ToolFramework::ReadTypeInfo(output, type_info, m_names)){ // follows the entry, or was seeked to through the directory
+	std::clog<<"ERROR BStore::ReadColumn : Error reading type info"<<std::endl;
+	return false;
+      }
+      sizes.push_back(found ? value.length() : COLUMN_MISSING);
+      data+=value;
+      if(m_type_checking) types.push_back(type_info[name]);
+    }
+    return true;
+  }
+
+  if(!FlushColumns()){
+    std::clog<<"ERROR BStore::ReadColumn : Error writing pending columnar entries"<<std::endl;
+    return false;
+  }
+
+  std::string chunk; // the key's values for the current group
+  uint64_t chunk_group=0;
+  std::map<std::string,ColumnChunk>::iterator column=m_columns.end();
+  for(unsigned int i=0; i<m_lookup.size(); i++){
+    if(m_lookup[i]!=chunk_group){
+      if(m_lookup[i]!=m_group_start && !LoadGroup(m_lookup[i])){
+	std::clog<<"ERROR BStore::ReadColumn : Error reading columnar group"<<std::endl;
+	return false;
+      }
+      chunk_group=m_lookup[i];
+      column=m_columns.find(name);
+      if(column!=m_columns.end()){
+	ColumnChunk& header=column->second;
+	chunk.resize(header.offsets.back()-header.offsets.front());
+	if(chunk.length() && (!output.Bseek(header.offsets.front(), SEEK_SET) || !output.Bread(&(chunk[0]), chunk.length()))){
+	  std::clog<<"ERROR BStore::ReadColumn : Error reading column "<<name<<std::endl;
+	  return false;
+	}
+      }
+    }
+    uint64_t row=m_directories[i];
+    if(column==m_columns.end() || row>=column->second.sizes.size() || column->second.sizes[row]==COLUMN_MISSING){
+      sizes.push_back(COLUMN_MISSING);
+      if(m_type_checking) types.push_back("");
+      continue;
+    }
+    ColumnChunk& header=column->second;
+    sizes.push_back(header.sizes[row]);
+    data.append(chunk, header.offsets[row]-header.offsets.front(), header.sizes[row]);
+    if(m_type_checking) types.push_back(header.types.size()==1 ? header.types[0] : header.types.at(row));
+  }
+
+  return true;
+}
+
+static bool CompactEntries(std::function<bool(unsigned int, BStore&)> read, unsigned int entries, const std::string& filename, enum_type type, bool header, bool type_checking, enum_codec codec, int codec_level, const BStore* header_store, const std::map<std::string,std::string>& indexes){
+
+  BStore out(header, type_checking);
+  if(!out.Initnew(filename, type, header, type_checking, 0, codec, codec_level)){
+    std::clog<<"ERROR BStore::Compact : Error creating "<<filename<<std::endl;
+    return false;
+  }
+  for(std::map<std::string,std::string>::const_iterator it=indexes.begin(); it!=indexes.end(); ++it){ // filled in as the entries are saved
+    if(!out.AddIndex(it->first, it->second)) return false;
+  }
+  if(header && header_store!=0 && out.Header!=0) out.Header->m_variables=header_store->m_variables;
+
+  BStore entry(false, type_checking);
+  for(unsigned int i=0; i<entries; i++){ // one entry in memory at a time
+    if(!read(i, entry)){
+      std::clog<<"ERROR BStore::Compact : Error reading entry "<<i<<std::endl;
+      return false;
+    }
+    out.m_variables.swap(entry.m_variables);
+    out.m_type_info.swap(entry.m_type_info);
+    if(!out.Save(i)){
+      std::clog<<"ERROR BStore::Compact : Error writing entry "<<i<<std::endl;
+      return false;
+    }
+  }
+
+  return out.Close();
+}
+
+bool BStore::Compact(std::string filename, bool background){
+
+  JoinCompact();
+  if(m_type==ram || m_type==shared_memory){
+    std::clog<<"ERROR BStore::Compact : ram and shared_memory stores have no file to compact"<<std::endl;
+    return false;
+  }
+  if(!FlushColumns() || !FlushBatch()){
+    std::clog<<"ERROR BStore::Compact : Error writing pending entries"<<std::endl;
+    return false;
+  }
+
+  m_compact_in_place= filename=="";
+  m_compact_name= m_compact_in_place ? m_file_name+".compact" : filename;
+  struct stat buffer;
+  if(m_compact_in_place) remove(m_compact_name.c_str()); // left by an earlier compaction that wasnt swapped in
+  else if(stat(filename.c_str(), &buffer) == 0){
+    std::clog<<"ERROR BStore::Compact : "<<filename<<" already exists"<<std::endl;
+    m_compact_name="";
+    return false;
+  }
+  m_compact_file_end=m_file_end;
+  m_compact_entries=m_lookup.size();
+  std::map<std::string,std::string> indexes;
+  for(std::map<std::string,ValueIndex>::iterator it=m_indexes.begin(); it!=m_indexes.end(); ++it) indexes[it->first]=it->second.type;
+
+  if(m_type!=compressed && m_type!=columnar){
+    std::shared_ptr<BStoreReader> reader(new BStoreReader);
+    if(!reader->Init(*this)){
+      m_compact_name="";
+      return false;
+    }
+    std::function<bool(unsigned int, BStore&)> read=[reader](unsigned int entry, BStore& out){ return reader->GetEntry(entry, out); };
+    if(background){ // the thread works from copies and the reader's snapshot, reading the file with positioned reads. Everything that would change the file joins it first
+      bool* ok=&m_compact_ok; // only read once the thread is joined
+      unsigned int entries=static_cast<unsigned int>(m_compact_entries);
+      std::string name=m_compact_name;
+      enum_type type=m_type;
+      bool header=m_has_header;
+      bool type_checking=m_type_checking;
+      enum_codec codec=m_codec;
+      int codec_level=m_codec_level;
+      m_compact_thread=std::thread([=](){ *ok=CompactEntries(read, entries, name, type, header, type_checking, codec, codec_level, reader->Header.get(), indexes); });
+      return true;
+    }
+    m_compact_ok=CompactEntries(read, m_compact_entries, m_compact_name, m_type, m_has_header, m_type_checking, m_codec, m_codec_level, reader->Header.get(), indexes);
+  }
+  else{ // no positioned reads, so go through this store's own stream
+    if(background) std::clog<<"Warning BStore::Compact : compressed and columnar files are compacted in the foreground"<<std::endl;
+    std::function<bool(unsigned int, BStore&)> read=[this](unsigned int entry, BStore& out){
+      if(!GetEntry(entry) || !LoadKeys()) return false;
+      out.m_variables.swap(m_variables);
+      out.m_type_info.swap(m_type_info);
+      return true;
+    };
+    m_compact_ok=CompactEntries(read, m_compact_entries, m_compact_name, m_type, m_has_header, m_type_checking, m_codec, m_codec_level, Header, indexes);
+    Delete();
+  }
+
+  return CompactWait();
+}
+
+bool BStore::CompactWait(){
+
+  JoinCompact();
+  if(m_compact_name=="") return m_compact_ok; // finished in the foreground, or never started
+  std::string name=m_compact_name;
+  m_compact_name="";
+  if(!m_compact_ok){
+    if(m_compact_in_place) remove(name.c_str());
+    return false;
+  }
+  if(!m_compact_in_place) return true;
+
+  if(m_file_end!=m_compact_file_end || m_lookup.size()!=m_compact_entries){
+    std::clog<<"ERROR BStore::CompactWait : entries were saved or deleted during compaction, compacted copy left in "<<name<<std::endl;
+    return false;
+  }
+  enum_type type= output.m_endpoint==MMAP ? uncompressed_mmap : m_type;
+  if(!Close()){
+    std::clog<<"ERROR BStore::CompactWait : Error closing "<<m_file_name<<", compacted copy left in "<<name<<std::endl;
+    return false;
+  }
+  if(rename(name.c_str(), m_file_name.c_str())){
+    std::clog<<"ERROR BStore::CompactWait : Error replacing "<<m_file_name<<" with "<<name<<std::endl;
+    return false;
+  }
+
+  return Initnew(m_file_name, type, m_has_header, m_type_checking, 0, m_codec, m_codec_level);
+}
+
+void BStore::JoinCompact(){
+
+  if(m_compact_thread.joinable()) m_compact_thread.join();
+
+}
+
+
+typedef bool (*IndexEncoder)(const std::string& data, uint64_t& key);
+
+template<typename T> static bool EncodeIndexValue(const std::string& data, uint64_t& key){ // values of arithmetic types are serialised as their bytes
+  
+  if(data.length()!=sizeof(T)) return false;
+  T value;
+  memcpy(&value, data.data(), sizeof(T));
+  key=IndexKey(value);
+  
+  return true;
+}
+
+static const std::map<std::string,IndexEncoder> index_encoders {
+#define encoder(type) { typeid(type).name(), &EncodeIndexValue<type> }
+  encoder(bool),
+  encoder(char),
+  encoder(signed char),
+  encoder(unsigned char),
+  encoder(short),
+  encoder(unsigned short),
+  encoder(int),
+  encoder(unsigned int),
+  encoder(long),
+  encoder(unsigned long),
+  encoder(long long),
+  encoder(unsigned long long),
+  encoder(float),
+  encoder(double)
+#undef encoder
+};
+
+bool BStore::AddIndex(const std::string& key, const std::string& type){
+  
+  if(index_encoders.count(type)==0){
+    std::clog<<"ERROR BStore::AddIndex : values of type "<<type<<" cant be indexed"<<std::endl;
+    return false;
+  }
+  std::map<std::string,ValueIndex>::iterator it=m_indexes.find(key);
+  if(it!=m_indexes.end()){
+    if(it->second.type==type) return true;
+    std::clog<<"ERROR BStore::AddIndex : "<<key<<" is already indexed as type "<<it->second.type<<std::endl;
+    return false;
+  }
+  
+  ValueIndex index;
+  index.type=type;
+  index.sorted=false;
+  if(!FillIndex(key, index)){
+    std::clog<<"ERROR BStore::AddIndex : Error reading "<<key<<" from existing entries"<<std::endl;
+    return false;
+  }
+  m_indexes[key]=index;
+  
+  return true;
+}
+
+bool BStore::FillIndex(const std::string& key, ValueIndex& index){
+  
+  index.values.assign(m_lookup.size(), 0);
+  index.present.assign(m_lookup.size(), 0);
+  index.sorted=false;
+  if(m_lookup.empty()) return true;
+  
+  std::string data;
+  std::vector<uint64_t> sizes;
+  std::vector<std::string> types;
+  if(!ReadColumn(key, data, sizes, types)) return false;
+  IndexEncoder encode=index_encoders.at(index.type);
+  uint64_t pos=0;
+  std::string value;
+  for(size_t i=0; i<sizes.size() && i<index.values.size(); i++){
+    if(sizes[i]==COLUMN_MISSING) continue;
+    value.assign(data, pos, sizes[i]);
+    pos+=sizes[i];
+    if(m_type_checking && types[i]!=index.type) continue;
+    index.present[i]=encode(value, index.values[i]);
+  }
+  
+  return true;
+}
+
+void BStore::UpdateIndexes(unsigned int entry){
+  
+  for(std::map<std::string,ValueIndex>::iterator it=m_indexes.begin(); it!=m_indexes.end(); ++it){
+    ValueIndex& index=it->second;
+    if(index.values.size()<m_lookup.size()){
+      index.values.resize(m_lookup.size(), 0);
+      index.present.resize(m_lookup.size(), 0);
+    }
+    std::map<std::string,BinaryStream>::iterator value=m_variables.find(it->first);
+    index.present[entry]= value!=m_variables.end() && (!m_type_checking || CheckType(it->first, index.type.c_str())) && index_encoders.at(index.type)(value->second.buffer, index.values[entry]);
+    index.sorted=false;
+  }
+  
+}
+
+bool BStore::QueryIndex(const std::string& key, const char* type, uint64_t min, uint64_t max, std::vector<unsigned int>& entries){
+  
+  entries.clear();
+  std::map<std::string,ValueIndex>::iterator it=m_indexes.find(key);
+  if(it==m_indexes.end()){
+    std::clog<<"ERROR BStore::Query : "<<key<<" is not indexed"<<std::endl;
+    return false;
+  }
+  ValueIndex& index=it->second;
+  if(index.type!=type){
+    std::clog<<"ERROR BStore::Query : "<<key<<" is indexed as type "<<index.type<<" not "<<type<<std::endl;
+    return false;
+  }
+  
+  if(!index.sorted){
+    index.order.clear();
+    for(uint32_t i=0; i<index.values.size() && i<m_lookup.size(); i++) if(index.present[i]) index.order.push_back(i);
+    const std::vector<uint64_t>& values=index.values;
+    std::stable_sort(index.order.begin(), index.order.end(), [&values](uint32_t a, uint32_t b){ return values[a]<values[b]; });
+    index.sorted=true;
+  }
+  if(min>max) return true;
+  
+  const std::vector<uint64_t>& values=index.values;
+  std::vector<uint32_t>::iterator first=std::lower_bound(index.order.begin(), index.order.end(), min, [&values](uint32_t entry, uint64_t value){ return values[entry]<value; });
+  std::vector<uint32_t>::iterator last=std::upper_bound(first, index.order.end(), max, [&values](uint64_t value, uint32_t entry){ return value<values[entry]; });
+  entries.assign(first, last);
+  std::sort(entries.begin(), entries.end()); // in file order for reading
+  
+  return true;
+}
+
+bool BStore::WriteIndexes(){
+  
+  uint32_t count=m_indexes.size();
+  if(!(output << count)) return false;
+  for(std::map<std::string,ValueIndex>::iterator it=m_indexes.begin(); it!=m_indexes.end(); ++it){
+    std::string key=it->first;
+    it->second.values.resize(m_lookup.size(), 0);
+    it->second.present.resize(m_lookup.size(), 0);
+    if(!(output << key) || !(output << it->second.type) || !(output << it->second.values) || !(output << it->second.present)) return false;
+  }
+  
+  return true;
+}
+
+bool BStore::ReadIndexes(){
+  
+  uint32_t count=0;
+  if(!(output >> count)) return false;
+  for(uint32_t i=0; i<count; i++){
+    std::string key;
+    if(!(output >> key)) return false;
+    ValueIndex& index=m_indexes[key];
+    if(!(output >> index.type) || !(output >> index.values) || !(output >> index.present) || index.values.size()!=index.present.size()) return false;
+    index.sorted=false;
+    if(index_encoders.count(index.type)==0){ // written on a platform with other type names
+      std::clog<<"Warning BStore::ReadIndexes : dropping index of "<<key<<" with unknown type "<<index.type<<std::endl;
+      m_indexes.erase(key);
+    }
+  }
+  
+  return true;
+}
+
+bool BStore::OpenRing(const std::string& name, bool header, bool type_checking){
+  
+  std::string shm_name=RingName(name);
+  m_ring_writer= m_ring_slots>0;
+  int fd=-1;
+  if(m_ring_writer){
+    if(!m_ring_slot_size){
+      std::clog<<"ERROR BStore::OpenRing : slot size must be above 0"<<std::endl;
+      return false;
+    }
+    m_ring_size=RingAlign(sizeof(RingHeader))+RingAlign(m_ring_slot_size)+m_ring_slots*RingAlign(sizeof(RingSlot)+m_ring_slot_size);
+    shm_unlink(shm_name.c_str()); // left by an earlier ring whose reader never closed
+    fd=shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd==-1 || ftruncate(fd, static_cast<off_t>(m_ring_size))){
+      std::clog<<"ERROR BStore::OpenRing : Error creating shared memory segment "<<shm_name<<std::endl;
+      if(fd!=-1){
+	close(fd);
+	shm_unlink(shm_name.c_str());
+      }
+      return false;
+    }
+  }
+  else{ // the writer may not have created it yet
+    struct stat buffer;
+    if(!RingWait([&](){
+	  if(fd==-1) fd=shm_open(shm_name.c_str(), O_RDWR, 0);
+	  return fd!=-1 && !fstat(fd, &buffer) && buffer.st_size>=(off_t)sizeof(RingHeader);
+	})){
+      std::clog<<"ERROR BStore::OpenRing : Timed out waiting for shared memory segment "<<shm_name<<std::endl;
+      if(fd!=-1) close(fd);
+      return false;
+    }
+    m_ring_size=static_cast<unsigned long int>(buffer.st_size);
+  }
+  
+  void* map=mmap(0, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // mapping stays valid after the descriptor is closed
+  if(map==MAP_FAILED){
+    std::clog<<"ERROR BStore::OpenRing : Error mapping shared memory segment "<<shm_name<<std::endl;
+    if(m_ring_writer) shm_unlink(shm_name.c_str());
+    return false;
+  }
+  unsigned long int ring_size=m_ring_size;
+  m_ring.reset(static_cast<char*>(map), [ring_size](char* p){ munmap(p, ring_size); });
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  
+  if(m_ring_writer){
+    new(ring) RingHeader; // ftruncate zeroed the segment
+    ring->slots=m_ring_slots;
+    ring->slot_size=m_ring_slot_size;
+    ring->has_header=header;
+    ring->type_checking=type_checking;
+    ring->header_length.store(0, std::memory_order_relaxed);
+    ring->magic.store(BSTORE_RING_MAGIC, std::memory_order_release);
+    RingNotify();
+  }
+  else{
+    if(!RingWait([ring](){ return ring->magic.load(std::memory_order_acquire)==BSTORE_RING_MAGIC; })){
+      std::clog<<"ERROR BStore::OpenRing : Timed out waiting for shared memory segment "<<shm_name<<" to be initialised"<<std::endl;
+      m_ring.reset();
+      return false;
+    }
+    m_ring_slots=0;
+    m_ring_slot_size=ring->slot_size;
+    header=ring->has_header;
+    type_checking=ring->type_checking;
+    if(m_ring_size<RingAlign(sizeof(RingHeader))+RingAlign(m_ring_slot_size)+ring->slots*RingAlign(sizeof(RingSlot)+m_ring_slot_size)){
+      std::clog<<"ERROR BStore::OpenRing : shared memory segment "<<shm_name<<" is smaller than its ring"<<std::endl;
+      m_ring.reset();
+      return false;
+    }
+  }
+  
+  m_file_name=name;
+  m_type=shared_memory;
+  m_codec=NO_CODEC;
+  m_lookup.clear();
+  m_directories.clear();
+  m_update=false;
+  m_type_checking=type_checking;
+  m_has_header=header;
+  if(Header!=0){
+    delete Header;
+    Header=0;
+  }
+  if(header) Header= new BStore(false,false);
+  m_ring_header_sequence=0;
+  output.Bclose();
+  output.m_endpoint=MMAP;
+  output.m_mode= m_ring_writer ? UPDATE : READ;
+  
+  return m_ring_writer || GetRingHeader();
+}
+
+bool BStore::CloseRing(){
+  
+  if(!m_ring) return true;
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  bool ret=true;
+  if(m_ring_writer){
+    ret=WriteRingHeader();
+    ring->writer_closed.store(1, std::memory_order_release);
+    shm_unlink(RingName(m_file_name).c_str()); // an attached reader keeps its own mapping
+  }
+  else{
+    ring->reader_closed.store(1, std::memory_order_release);
+    if(!ring->writer_closed.load(std::memory_order_acquire)) shm_unlink(RingName(m_file_name).c_str()); // the writer may have died, once closed the name may belong to a new ring
+  }
+  RingNotify();
+  output.Bclose();
+  m_ring.reset();
+  m_ring_writer=false;
+  Delete();
+  
+  return ret;
+}
+
+bool BStore::SaveRing(){
+  
+  if(!m_ring || !m_ring_writer){
+    std::clog<<"ERROR BStore::Save : only the process that created the shared memory ring can save to it"<<std::endl;
+    return false;
+  }
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  uint64_t entry=ring->written.load(std::memory_order_relaxed);
+  if(!entry && !WriteRingHeader()) return false; // so the reader has it from the start
+  unsigned int slots=m_ring_slots;
+  if(!RingWait([ring, entry, slots](){ return ring->reader_closed.load(std::memory_order_acquire) || entry-ring->read.load(std::memory_order_acquire)<slots; })){
+    std::clog<<"ERROR BStore::Save : Timed out waiting for the reader to free a shared memory slot"<<std::endl;
+    return false;
+  }
+  if(ring->reader_closed.load(std::memory_order_acquire)){
+    std::clog<<"ERROR BStore::Save : the reader has closed the shared memory ring"<<std::endl;
+    return false;
+  }
+  
+  RingSlot* slot=GetRingSlot(entry);
+  output.m_map=std::shared_ptr<char>(m_ring, reinterpret_cast<char*>(slot)+sizeof(RingSlot)); // written in place
+  output.m_map_size=m_ring_slot_size;
+  output.m_pos=0;
+  uint64_t directory=0;
+  if(!WriteEntry(output, 0, directory)){
+    std::clog<<"ERROR BStore::Save : Error writing entry to shared memory, it may be larger than the slot size of "<<m_ring_slot_size<<" bytes"<<std::endl;
+    return false;
+  }
+  slot->length=output.Btell();
+  slot->directory=directory;
+  slot->entry.store(entry+1, std::memory_order_release);
+  ring->written.store(entry+1, std::memory_order_release);
+  RingNotify();
+  
+  return true;
+}
+
+bool BStore::GetRingEntry(unsigned int entry, uint64_t& directory){
+  
+  if(!m_ring || m_ring_writer){
+    std::clog<<"ERROR BStore::GetEntry : only the process that attached to the shared memory ring can read from it"<<std::endl;
+    return false;
+  }
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  uint64_t released=ring->read.load(std::memory_order_relaxed);
+  if(entry<released){
+    std::clog<<"ERROR BStore::GetEntry : Entry "<<entry<<" has already been released to the writer"<<std::endl;
+    return false;
+  }
+  if(!RingWait([ring, entry](){ return ring->written.load(std::memory_order_acquire)>entry || ring->writer_closed.load(std::memory_order_acquire); })){
+    std::clog<<"ERROR BStore::GetEntry : Timed out waiting for entry "<<entry<<std::endl;
+    return false;
+  }
+  if(ring->written.load(std::memory_order_acquire)<=entry){
+    std::clog<<"ERROR BStore::GetEntry : Entry outside of range"<<std::endl;
+    return false;
+  }
+  if(entry>released){
+    ring->read.store(entry, std::memory_order_release); // earlier slots can be reused
+    RingNotify();
+  }
+  
+  RingSlot* slot=GetRingSlot(entry);
+  if(slot->entry.load(std::memory_order_acquire)!=entry+1ULL || slot->length>m_ring_slot_size){
+    std::clog<<"ERROR BStore::GetEntry : shared memory slot doesnt hold entry "<<entry<<std::endl;
+    return false;
+  }
+  output.m_map=std::shared_ptr<char>(m_ring, reinterpret_cast<char*>(slot)+sizeof(RingSlot)); // read in place
+  output.m_map_size=slot->length;
+  output.m_pos=0;
+  directory=slot->directory;
+  if(m_has_header && ring->header_sequence.load(std::memory_order_acquire)!=m_ring_header_sequence && !GetRingHeader()) return false;
+  
+  return true;
+}
+
+bool BStore::WriteRingHeader(){
+  
+  if(!m_has_header || Header==0) return true;
+  
+  BinaryStream stream;
+  if(!Header->Materialise() || !(stream << Header->m_variables)){
+    std::clog<<"ERROR BStore::WriteRingHeader : Error serialising Header varaibles"<<std::endl;
+    return false;
+  }
+  if(stream.buffer.length()>m_ring_slot_size){
+    std::clog<<"ERROR BStore::WriteRingHeader : Header is larger than the slot size of "<<m_ring_slot_size<<" bytes"<<std::endl;
+    return false;
+  }
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  uint64_t sequence=ring->header_sequence.load(std::memory_order_relaxed);
+  ring->header_sequence.store(sequence+1, std::memory_order_relaxed); // readers retry while it is odd
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->header_length.store(stream.buffer.length(), std::memory_order_relaxed);
+  RingStore(area, stream.buffer);
+  ring->header_sequence.store(sequence+2, std::memory_order_release);
+  RingNotify();
+  
+  return true;
+}
+
+bool BStore::GetRingHeader(){
+  
+  if(!m_has_header) return true;
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  uint64_t sequence=0;
+  uint64_t slot_size=m_ring_slot_size;
+  BinaryStream stream;
+  if(!RingWait([&](){ // copied out first so it cant change while being deserialised
+	sequence=ring->header_sequence.load(std::memory_order_acquire);
+	if(sequence & 1) return false;
+	uint64_t length=ring->header_length.load(std::memory_order_relaxed);
+	if(length>slot_size) return false;
+	RingLoad(area, stream.buffer, length);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return ring->header_sequence.load(std::memory_order_relaxed)==sequence;
+      })){
+    std::clog<<"ERROR BStore::GetHeader : Timed out reading header from shared memory"<<std::endl;
+    return false;
+  }
+  
+  if(Header==0) Header= new BStore(false, false);
+  Header->Delete();
+  if(sequence && !(stream >> Header->m_variables)){ // nothing has been written before the first save
+    std::clog<<"ERROR BStore::GetHeader : Error retreiving header"<<std::endl;
+    return false;
+  }
+  m_ring_header_sequence=sequence;
+  
+  return true;
+}
+
+bool BStore::RingWait(const std::function<bool()>& ready){
+  
+  std::chrono::steady_clock::time_point end=std::chrono::steady_clock::now()+std::chrono::milliseconds(m_ring_timeout);
+  char* area=0;
+  RingHeader* ring= m_ring ? GetRingHeaderArea(area) : 0;
+  for(unsigned int tries=0; ; tries++){
+    uint32_t wake= ring ? ring->wake.load() : 0; // read before checking, so a change made after the check ends the wait
+    if(ready()) return true;
+    std::chrono::steady_clock::duration left=end-std::chrono::steady_clock::now();
+    if(m_ring_timeout>=0 && left.count()<=0) return false;
+    if(tries<100) std::this_thread::yield(); // the other side is usually only just behind
+    else if(ring==0) usleep(100); // no segment to block on until the writer creates it
+    else{
+      struct timespec timeout;
+      std::chrono::nanoseconds ns=std::chrono::duration_cast<std::chrono::nanoseconds>(left);
+      timeout.tv_sec=static_cast<time_t>(ns.count()/1000000000);
+      timeout.tv_nsec=static_cast<long int>(ns.count()%1000000000);
+      ring->waiters.fetch_add(1);
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ring->wake), FUTEX_WAIT, wake, m_ring_timeout>=0 ? &timeout : 0, 0, 0); // returns at once if wake has changed
+      ring->waiters.fetch_sub(1);
+    }
+  }
+  
+}
+
+void BStore::RingNotify(){
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  ring->wake.fetch_add(1);
+  if(ring->waiters.load()) syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ring->wake), FUTEX_WAKE, INT_MAX, 0, 0, 0);
+  
+}
+
+RingHeader* BStore::GetRingHeaderArea(char*& area){
+  
+  area=m_ring.get()+RingAlign(sizeof(RingHeader));
+  return reinterpret_cast<RingHeader*>(m_ring.get());
+  
+}
+
+RingSlot* BStore::GetRingSlot(uint64_t entry){
+  
+  char* area=0;
+  RingHeader* ring=GetRingHeaderArea(area);
+  return reinterpret_cast<RingSlot*>(area+RingAlign(ring->slot_size)+(entry%ring->slots)*RingAlign(sizeof(RingSlot)+ring->slot_size));
+  
+}
+
+bool BStore::ReadJournal(const std::string& filename, uint64_t& base, uint64_t& end, bool& header, bool& type_checking, std::vector<JournalRecord>& records){
+
+  records.clear();
+  FILE* journal=fopen((filename+".journal").c_str(), "rb");
+  if(journal==0) return false;
+  uint32_t magic=0;
+  if(!fread(&magic, sizeof(magic), 1, journal) || magic!=BSTORE_JOURNAL_MAGIC || !fread(&base, sizeof(base), 1, journal) || !fread(&header, sizeof(header), 1, journal) || !fread(&type_checking, sizeof(type_checking), 1, journal)){
+    std::clog<<"ERROR BStore::ReadJournal : "<<filename<<".journal is not a BStore journal"<<std::endl;
+    fclose(journal);
+    return false;
+  }
+  end=base;
+
+  FILE* data=fopen(filename.c_str(), "rb");
+  uint64_t data_size=0;
+  if(data!=0 && !fseek(data, 0, SEEK_END)) data_size=static_cast<uint64_t>(ftell(data));
+
+  std::string buffer;
+  JournalRecord record;
+  // stop at the first record that is incomplete or whose entry didnt fully reach the file, anything after it was written later
+  while(fread(&record.entry, sizeof(record.entry), 1, journal) && fread(&record.offset, sizeof(record.offset), 1, journal) && fread(&record.length, sizeof(record.length), 1, journal) && fread(&record.directory, sizeof(record.directory), 1, journal) && fread(&record.checksum, sizeof(record.checksum), 1, journal)){
+    if(record.length){
+      if(data==0 || record.offset<base || record.offset+record.length>data_size) break;
+      buffer.resize(record.length);
+      if(fseek(data, static_cast<long int>(record.offset), SEEK_SET) || !fread(&buffer[0], record.length, 1, data) || JournalChecksum(buffer.data(), record.length)!=record.checksum) break;
+      if(record.offset+record.length>end) end=record.offset+record.length;
+    }
+    records.push_back(record);
+  }
+
+  if(data!=0) fclose(data);
+  fclose(journal);
+
+  return true;
+}
+
+bool BStore::OpenJournal(){
+
+  if(m_type!=uncompressed || output.m_endpoint!=UNCOMPRESSED){
+    std::clog<<"Warning BStore::OpenJournal : only uncompressed files can be journaled, journal disabled"<<std::endl;
+    m_journaled=false;
+    return true;
+  }
+
+  std::string name=m_file_name+".journal";
+  struct stat buffer;
+  bool exists= stat(name.c_str(), &buffer) == 0;
+  m_journal=fopen(name.c_str(), exists ? "ab" : "wb");
+  if(m_journal==0) return false;
+  if(exists) return true;
+  
+  uint32_t magic=BSTORE_JOURNAL_MAGIC;
+  uint64_t base=m_file_end;
+  if(!fwrite(&magic, sizeof(magic), 1, m_journal) || !fwrite(&base, sizeof(base), 1, m_journal) || !fwrite(&m_has_header, sizeof(m_has_header), 1, m_journal) || !fwrite(&m_type_checking, sizeof(m_type_checking), 1, m_journal) || fflush(m_journal)) return false;
+
+  return true;
+}
+
+bool BStore::WriteJournal(unsigned int entry, uint64_t offset, uint64_t length, uint64_t directory, uint32_t checksum, bool flush){
+
+  JournalRecord record;
+  record.entry=entry;
+  record.offset=offset;
+  record.length=length;
+  record.directory=directory;
+  record.checksum=checksum;
+  if(!fwrite(&record.entry, sizeof(record.entry), 1, m_journal) || !fwrite(&record.offset, sizeof(record.offset), 1, m_journal) || !fwrite(&record.length, sizeof(record.length), 1, m_journal) || !fwrite(&record.directory, sizeof(record.directory), 1, m_journal) || !fwrite(&record.checksum, sizeof(record.checksum), 1, m_journal)) return false;
+  if(!flush) return true;
+
+  // the order the entry and its record reach the disk doesnt matter, recovery checks the record's checksum against the file
+  return !fflush(output.pfile) && !fflush(m_journal) && !fdatasync(fileno(output.pfile)) && !fdatasync(fileno(m_journal));
+
+}
+
+void BStore::CloseJournal(bool remove){
+
+  if(m_journal){
+    fclose(m_journal);
+    m_journal=0;
+  }
+  if(remove && m_file_name!="") unlink((m_file_name+".journal").c_str());
+
+}
+
+static void PrefetchThread(Prefetcher* prefetcher){
+
+  std::unique_lock<std::mutex> lock(prefetcher->mtx);
+  while(!prefetcher->stop){
+    if(prefetcher->failed || prefetcher->ready.size()>=prefetcher->depth || prefetcher->next>=prefetcher->lookup.size()){
+      prefetcher->cv.wait(lock);
+      continue;
+    }
+    ColumnRow row;
+    row.entry=prefetcher->next++;
+    unsigned int generation=prefetcher->generation;
+    lock.unlock(); // read without holding up GetEntry
+    bool ok= prefetcher->stream.Bseek(prefetcher->lookup[row.entry], SEEK_SET) && (prefetcher->stream >> row.variables) && (!prefetcher->type_checking || ReadTypeInfo(prefetcher->stream, row.type_info, prefetcher->names));
+    lock.lock();
+    if(generation!=prefetcher->generation) continue;
+    if(!ok) prefetcher->failed=true;
+    else prefetcher->ready.push_back(std::move(row));
+    prefetcher->cv.notify_all();
+  }
+
+}
+
+bool BStore::StartPrefetch(unsigned int entry){
+
+  enum_endpoint endpoint=output.m_endpoint;
+  if(endpoint==POST_PRE_COMPRESS) endpoint=UNCOMPRESSED; // read the decompressed temporary file
+  if(m_type==columnar || endpoint==RAM) return false;
+
+  Prefetcher* prefetcher=new Prefetcher;
+  if(!prefetcher->stream.Bopen(output.m_file_name, READ, endpoint, (endpoint==BLOCK_COMPRESSED ? m_flags_start : 0))){
+    delete prefetcher;
+    m_prefetch_depth=0; // dont keep trying
+    std::clog<<"Warning BStore::StartPrefetch : Could not open "<<output.m_file_name<<" to read ahead, prefetching disabled"<<std::endl;
+    return false;
+  }
+  prefetcher->lookup=m_lookup;
+  prefetcher->names=m_names;
+  prefetcher->type_checking=m_type_checking;
+  prefetcher->depth=m_prefetch_depth;
+  prefetcher->next=entry;
+  prefetcher->generation=0;
+  prefetcher->stop=false;
+  prefetcher->failed=false;
+  prefetcher->thread=std::thread(PrefetchThread, prefetcher);
+  m_prefetcher=prefetcher;
+
+  return true;
+}
+
+void BStore::StopPrefetch(){
+
+  if(!m_prefetcher) return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_prefetcher->mtx);
+    m_prefetcher->stop=true;
+  }
+  m_prefetcher->cv.notify_all();
+  m_prefetcher->thread.join();
+  m_prefetcher->stream.Bclose(true);
+  delete m_prefetcher;
+  m_prefetcher=0;
+
+}
+
+bool BStore::TakePrefetched(unsigned int entry){
+
+  std::unique_lock<std::mutex> lock(m_prefetcher->mtx);
+  while(!m_prefetcher->ready.empty() && m_prefetcher->ready.front().entry<entry) m_prefetcher->ready.pop_front();
+  while(m_prefetcher->ready.empty() && entry<m_prefetcher->next && !m_prefetcher->failed) m_prefetcher->cv.wait(lock); // being read now
+
+  if(m_prefetcher->ready.empty() || m_prefetcher->ready.front().entry!=entry){ // not sequential, carry on from here
+    m_prefetcher->ready.clear();
+    m_prefetcher->next=entry+1;
+    m_prefetcher->generation++;
+    m_prefetcher->failed=false;
+    m_prefetcher->cv.notify_all();
+    return false;
+  }
+
+  m_generation=++generations;
+  m_variables.swap(m_prefetcher->ready.front().variables);
+  m_type_info.swap(m_prefetcher->ready.front().type_info);
+  m_prefetcher->ready.pop_front();
+  m_prefetcher->cv.notify_all();
+
+  return true;
+}
+
+unsigned int BStore::NumEntries(){
+  
+  if(m_type==shared_memory && m_ring){ // entries saved so far
+    char* area=0;
+    return GetRingHeaderArea(area)->written.load(std::memory_order_acquire);
+  }
+  return m_lookup.size();
+  
+}
+
+BStore::~BStore(){
+
+  StopPrefetch();
+  JoinCompact();
+  CloseJournal(false);
+  CloseRing();
 
   delete Header;
   Header=0;
@@ -960,6 +2702,41 @@ namespace ToolFramework {
   bool json_encode(std::ostream& output, const BStore& store) {
     return store.JsonEncode(output);
   }
+
+  bool ReadTypeInfo(BinaryStream& stream, std::map<std::string,std::string>& type_info, const std::vector<std::string>& names, std::vector<std::string>* extend, std::map<std::string,uint32_t>* type_ids){
+
+    type_info.clear();
+    uint32_t marker=0;
+    if(!(stream >> marker)) return false;
+    if(marker!=TYPE_DICTIONARY_MARKER){ // the size of a map of strings, as written before version 5
+      uint64_t size=marker;
+      if(marker==LONG_SIZE && !(stream >> size)) return false;
+      for(uint64_t i=0; i<size; i++){
+	std::string key;
+	if(!(stream >> key) || !(stream >> type_info[key])) return false;
+      }
+      return true;
+    }
+
+    uint32_t first=0;
+    std::vector<std::string> added;
+    std::vector<uint32_t> ids;
+    if(!(stream >> first) || !(stream >> added) || !(stream >> ids) || ids.size()%2) return false;
+    if(extend && first==names.size()) extend->insert(extend->end(), added.begin(), added.end()); // extend may be names
+    for(size_t i=0; i<ids.size(); i+=2){
+      const std::string* name[2];
+      for(size_t j=0; j<2; j++){
+	uint32_t id=ids[i+j];
+	if(id<names.size()) name[j]=&names[id];
+	else if(id>=first && id-first<added.size()) name[j]=&added[id-first];
+	else return false;
+      }
+      type_info[*name[0]]=*name[1];
+      if(type_ids && ids[i+1]<names.size()) (*type_ids)[*name[0]]=ids[i+1];
+    }
+
+    return true;
+  }
 }
 
 template <typename T>
@@ -1026,6 +2803,8 @@ bool BStore::JsonEncode(std::ostream& stream) const {
     return false;
   };
 
+  if (!m_held.empty()) const_cast<BStore*>(this)->Materialise(); // only brings m_variables up to date with the held values
+
   bool comma = false;
   stream << '{';
   for (auto& kv : m_variables) {
@@ -1057,6 +2836,12 @@ bool BStore::JsonEncode(const std::string& key, std::ostream& stream) const {
     return false;
   };
 
+  if (!m_held.empty()) { // only brings m_variables up to date with the held value
+    BStore* store = const_cast<BStore*>(this);
+    auto held = store->m_held.find(key);
+    if (held != store->m_held.end() && !store->Materialise(held)) return false;
+  };
+
   auto kv = m_variables.find(key);
   if (kv == m_variables.end()) return false;
   auto encoder = GetJsonEncoder(kv->first);
@@ -4,12 +4,22 @@
 #include <iostream>
 #include <stdio.h>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include <string.h>
 #include "zlib.h"
 #include <unistd.h> //for lseek
 #include <sstream>
 #include <assert.h>
 #include <typeinfo>
+#include <type_traits>
+#include <utility>
 #include <SerialisableObject.h>
 #include <PointerWrapper.h>
 
@@ -19,8 +29,247 @@
 
 namespace ToolFramework{
   
-  enum enum_type {uncompressed, compressed, post_pre_compress, ram};
+  enum enum_type {uncompressed, compressed, post_pre_compress, ram, uncompressed_mmap, block_compressed, columnar, shared_memory}; // uncompressed_mmap opens an existing uncompressed file read only through a memory mapping (new files are created as uncompressed), block_compressed is a seekable container of compressed frames, columnar stores groups of entries key by key in a block_compressed container, shared_memory passes entries from one process to another through a ring of slots in a POSIX shared memory segment (see BStore::SetRing)
   
+  /**
+   * \struct KeyLocation
+   *
+   * Position of one key's value within a saved BStore entry, as recorded in the entry's key directory.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct KeyLocation{
+    
+    uint64_t offset; ///< file position of the serialised value
+    uint64_t size; ///< length of the serialised value in bytes
+    
+  };
+  
+  /**
+   * \struct JournalRecord
+   *
+   * One save or deletion recorded in the journal of a journaled BStore, used to rebuild the lookup of a file that was not closed.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct JournalRecord{
+    
+    uint32_t entry; ///< entry number saved or deleted
+    uint64_t offset; ///< file position of the saved entry, 0 for a deletion
+    uint64_t length; ///< bytes written for the entry including its key directory, 0 for a deletion
+    uint64_t directory; ///< file position of the entry's key directory
+    uint32_t checksum; ///< checksum of the entry's bytes
+    
+  };
+  
+  /**
+   * \struct ColumnChunk
+   *
+   * Header of one key's values for a group of entries in a columnar BStore. The values of each row follow the header back to back.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct ColumnChunk{
+    
+    std::vector<uint64_t> sizes; ///< length of each row's value, COLUMN_MISSING if the row doesnt have the key
+    std::vector<std::string> types; ///< type of the values when type checking, a single element if all rows share it
+    std::vector<uint64_t> offsets; ///< file position of each row's value plus the end of the chunk (not stored)
+    
+  };
+  
+  /**
+   * \struct ColumnRow
+   *
+   * An entry's values held in memory, while waiting for its columnar group to be written or after being read ahead by a Prefetcher.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct ColumnRow{
+    
+    unsigned int entry; ///< entry number it was saved as or read from
+    std::map<std::string,BinaryStream> variables; ///< the entry's values
+    std::map<std::string,std::string> type_info; ///< the entry's types when type checking
+    
+  };
+  
+  
+  
+  /**
+   * \struct Prefetcher
+   *
+   * State shared between a BStore and the background thread reading entries ahead of sequential GetEntry calls. The thread has its own handle on the file.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct Prefetcher{
+    
+    BinaryStream stream; ///< the thread's own handle on the file
+    std::vector<uint64_t> lookup; ///< entry positions at the time the thread started
+    std::vector<std::string> names; ///< type dictionary at the time the thread started
+    bool type_checking; ///< if entries are followed by their type info
+    unsigned int depth; ///< number of entries to hold ready
+    unsigned int next; ///< next entry for the thread to read
+    unsigned int generation; ///< incremented when the reader is moved so entries read for the old position are dropped
+    bool stop; ///< tells the thread to exit
+    bool failed; ///< set if the thread could not read an entry
+    std::deque<ColumnRow> ready; ///< entries read ahead in order
+    std::mutex mtx; ///< guards all the above except stream
+    std::condition_variable cv; ///< signals new entries and requests
+    std::thread thread; ///< the reading thread
+    
+  };
+  
+  /**
+   * \struct RingHeader
+   *
+   * Start of the shared memory segment of a shared_memory BStore. It is followed by an area for the serialised header and then the ring of slots, each a RingSlot followed by the entry's bytes, all 64 byte aligned. The atomics are shared between the writing and reading processes. The header area is only accessed as atomic 64 bit words, as the reader may copy it while the writer rewrites it.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct RingHeader{
+    
+    std::atomic<uint32_t> magic; ///< BSTORE_RING_MAGIC once the writer has filled in the rest
+    uint32_t slots; ///< number of entry slots
+    uint64_t slot_size; ///< bytes available for each entry, and for the header
+    bool has_header; ///< if the store has a header
+    bool type_checking; ///< if entries are followed by their type info
+    std::atomic<uint64_t> written; ///< number of entries saved
+    std::atomic<uint64_t> read; ///< oldest entry the reader may still be using, the writer doesnt overwrite it
+    std::atomic<uint64_t> header_sequence; ///< incremented before and after the header is written, odd while it is being written
+    std::atomic<uint64_t> header_length; ///< bytes of the serialised header
+    std::atomic<uint32_t> writer_closed; ///< set when the writer closes, no more entries will follow
+    std::atomic<uint32_t> reader_closed; ///< set when the reader closes, saves would never be read
+    std::atomic<uint32_t> wake; ///< futex word incremented after every change the other process may be waiting for
+    std::atomic<uint32_t> waiters; ///< number of processes blocked on wake, so changes only make a wake up call when needed
+    
+  };
+  
+  /**
+   * \struct RingSlot
+   *
+   * Start of each entry slot in a shared_memory BStore's segment, followed by the entry in the same layout as in files.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct RingSlot{
+    
+    std::atomic<uint64_t> entry; ///< entry number held plus one, set once the entry has been written
+    uint64_t length; ///< bytes of the entry
+    uint64_t directory; ///< position of the entry's key directory within the slot
+    
+  };
+  
+  /**
+   * \struct ValueIndex
+   *
+   * Secondary index of one key's values across the entries of a BStore, used to find the entries holding given values without reading them. Values are kept as IndexKey encodings so all arithmetic types compare as unsigned integers.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct ValueIndex{
+    
+    std::string type; ///< typeid name of the indexed values
+    std::vector<uint64_t> values; ///< each entry's encoded value
+    std::vector<uint8_t> present; ///< if each entry has the key with the indexed type
+    std::vector<uint32_t> order; ///< entries with the key sorted by value, rebuilt by the first query after a change (not saved)
+    bool sorted; ///< if order is up to date
+    
+  };
+  
+  /**
+     Encodes a value of a signed integer type as a 64 bit key whose unsigned order is the value order.
+     @param value value to encode.
+  */
+  template<typename T> typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, uint64_t>::type IndexKey(T value){ return static_cast<uint64_t>(static_cast<int64_t>(value)) ^ UINT64_C(0x8000000000000000); }
+  template<typename T> typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, uint64_t>::type IndexKey(T value){ return value; } ///< Encodes an unsigned integer as an index key. @param value value to encode.
+  template<typename T> typename std::enable_if<std::is_floating_point<T>::value, uint64_t>::type IndexKey(T value){ ///< Encodes a floating point value as an index key, negative values have all bits flipped so they sort below positive ones. @param value value to encode.
+    double number= value==0 ? 0 : value; // -0 and 0 are the same key
+    uint64_t bits=0;
+    memcpy(&bits, &number, sizeof(bits));
+    return (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+  }
+  
+  /**
+   * \struct KeyHandle
+   *
+   * A key resolved once, for repeated Get and Set calls on a BStore without looking the key up each time. The handle remembers where the key's value is and looks it up again only after the store's entries have been cleared or removed (e.g. by GetEntry or Delete) or when used with a different store.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct KeyHandle{
+    
+    KeyHandle(const std::string& key=""): name(key), store(0), generation(0){} ///< @param key the key to handle
+    std::string name; ///< the key
+    const void* store; ///< store the cached positions belong to, 0 if not resolved
+    uint64_t generation; ///< the store's generation when resolved
+    std::map<std::string,BinaryStream>::iterator value; ///< the key's value
+    std::map<std::string,std::string>::iterator type; ///< the key's type info, end if not yet known
+    std::map<std::string,uint32_t>::iterator type_id; ///< dictionary id of the key's type, end if not yet known
+    
+  };
+  
+  /**
+   * \class HeldValueBase
+   *
+   * Abstract base of the typed values kept by a BStore in in memory mode, which are only serialised when the store is saved, serialised or JSON encoded.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  class HeldValueBase : public PointerWrapperBase {
+    
+  public:
+    
+    HeldValueBase(): dirty(true){} ///< Simple constructor
+    virtual bool Serialise(BinaryStream& stream)=0; ///< replaces the contents of stream with the serialised value @param stream stream to write to
+    virtual const std::type_info& Type() const =0; ///< type of the held value
+    virtual HeldValueBase* Clone() const =0; ///< copy of the held value
+    bool dirty; ///< if the value may have changed since it was last serialised
+    
+  };
+  
+  /**
+   * \class HeldValue
+   *
+   * Templated derived class of HeldValueBase holding a copy of a value set in an in memory BStore.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  template <class T> class HeldValue : public HeldValueBase {
+    
+  public:
+    
+    T value; ///< the held value
+    template<typename... Args> HeldValue(Args&&... args): value(std::forward<Args>(args)...){} ///< Constructor @param args value to copy or move, or arguments to construct it from
+    bool Serialise(BinaryStream& stream){ stream.Reset(); return stream << value; }
+    const std::type_info& Type() const { return typeid(T); }
+    HeldValueBase* Clone() const { return new HeldValue<T>(value); }
+    
+  };
+  
+  /// Whether values of a type can be held in in memory mode, types that cant be copied (such as nested BStores) are always serialised
+  template <class T> struct Holdable : std::integral_constant<bool, std::is_copy_constructible<T>::value && std::is_copy_assignable<T>::value> {};
   
   /**
    * \class BStore
@@ -35,7 +284,14 @@ namespace ToolFramework{
   
   class BStore: public SerialisableObject{
     
+    friend class BStoreReader;
+    
 #define CHUNK 16384
+#define BSTORE_FLAGS_MAGIC 0x47414C46 // "FLAG" ends the flags block from version 2
+#define BSTORE_JOURNAL_MAGIC 0x4C4E524A // "JRNL" starts a journal file
+#define BSTORE_RING_MAGIC 0x474E4952 // "RING" marks an initialised shared memory segment
+#define TYPE_DICTIONARY_MARKER 0xFFFFFFFE // starts an entry's type info written as dictionary ids, older entries start with the size of a map of strings
+#define COLUMN_MISSING 0xFFFFFFFFFFFFFFFFULL // size of a value absent from a row of a columnar group
     
   public:
     
@@ -44,10 +300,10 @@ namespace ToolFramework{
     ~BStore();
     //  void Init();
     // void Init2();
-    bool Initnew(std::string filename, enum_type type=post_pre_compress, bool header=true, bool type_checking=false, unsigned int file_end=0);    
+    bool Initnew(std::string filename, enum_type type=post_pre_compress, bool header=true, bool type_checking=false, unsigned long int file_end=0, enum_codec codec=Codec::Default(), int codec_level=-1); ///< codec and codec_level choose the compression for block_compressed files and the zlib level for compressed and post_pre_compress. Existing files keep the codec recorded in their flags.
     bool Initnew(BinaryStream& bs, unsigned int position);    
-    bool GetFlags(unsigned int file_end);
-    bool GetFlags(std::string filename, unsigned int file_end);
+    bool GetFlags(unsigned long int file_end);
+    bool GetFlags(std::string filename, unsigned long int file_end);
     bool WriteHeader();
     bool WriteLookup();
     bool WriteFlags();
@@ -58,12 +314,59 @@ namespace ToolFramework{
     unsigned int NumEntries();
     bool Close();
     bool Rollback();
+    bool Compact(std::string filename="", bool background=false); ///< Copy the live entries, in entry order, and the header to a new file of the same type, leaving out overwritten and deleted entries and old lookup and flags blocks. Only one entry is held in memory at a time. @param filename file to write, "" to replace this store's file once finished (this store is closed and reopened) @param background if true the copy is made on a separate thread and this returns straight away, entries can still be read meanwhile but Save, DeleteEntry and Close wait for it to finish. Compressed and columnar files are always compacted in the foreground, reading through this store which clears its loaded entry @return false on error
+    bool CompactWait(); ///< wait for a background Compact to finish and, if compacting in place, swap the compacted file in. The swap is refused if entries were saved or deleted since Compact was called @return false if the compaction failed or none was started
+    void SetJournal(bool journal){ m_journaled=journal; } ///< Call before Initnew. In journaled mode each Save and DeleteEntry appends a record to filename.journal, which is removed by Close. If Initnew finds a journal the file was not closed and its entries are recovered from the records (the header is only recovered from the last Close). Only uncompressed files can be journaled. @param journal true to enable
+    void SetBatch(unsigned int entries, unsigned long int bytes=4194304){ FlushBatch(); m_batch_entries=entries; m_batch_bytes=bytes; m_batch.Reset(); } ///< Buffer saved entries in memory and write them to file together, in one write and one seek, once the batch holds the given number of entries or bytes. Batched entries are also written by GetEntry, Close and Compact. Compressed files compress the batch as a whole. @param entries entries per batch, 0 to write each Save straight away @param bytes size at which a batch is written early
+    void SetLazy(bool lazy){ m_lazy=lazy; } ///< In lazy mode GetEntry only reads the entry's key directory and type info, each key's value is then read from file the first time it is accessed. Entries saved before version 4 have no directory and are read in full. @param lazy true to enable
+    void SetPrefetch(unsigned int depth, bool sequential_only=true){ StopPrefetch(); m_prefetch_depth=depth; m_prefetch_sequential=sequential_only; } ///< Read up to depth entries ahead of GetEntry on a background thread with its own file handle, so the next entry is ready when asked for. Only applies when reading whole entries (not lazy or columnar) from a file that is not being saved to. @param depth number of entries to read ahead, 0 to disable @param sequential_only if true the reader starts once GetEntry is called for consecutive entries, otherwise at the next GetEntry
+    void SetColumnRows(unsigned int rows){ m_column_rows= rows ? rows : 1; } ///< number of entries gathered into each group of a columnar file before it is written @param rows entries per group
+    bool LoadKeys(); ///< Reads any keys of a lazily loaded entry that have not been accessed yet and serialises values held in in memory mode, so the whole entry is in m_variables. Needed before iterating m_variables in lazy or in memory mode.
+    void SetInMemory(bool in_memory){ m_in_memory=in_memory; } ///< In in memory mode Set keeps a typed copy of each value instead of serialising it, and Get of the same type copies it back (or for pointer Gets hands out the held object itself) without deserialising. Values are serialised into m_variables only when needed, by Save, Serialise, JsonEncode, Print, LoadKeys, operator[] and BinaryView Gets, or when read back as a different type. Intended for passing data between tools in the same process. @param in_memory true to enable
+    void SetRing(unsigned int slots, unsigned long int slot_size=1048576){ m_ring_slots=slots; m_ring_slot_size=slot_size; } ///< Call before Initnew with type shared_memory in the process that will Save entries, Initnew then creates the named shared memory segment (replacing any left over) holding a ring of entry slots. Each Save serialises the entry straight into the next slot, waiting while all slots hold entries the reader hasnt moved past, and ignores the entry number. A process calling Initnew with the same name without SetRing attaches as the reader, waiting for the segment to be created, and GetEntry reads each entry straight from its slot, waiting until it has been saved. The reader may only go forwards, an entry stays readable until a later one is requested. Close marks the writer as finished, GetEntry past the last entry then fails. The writer's Close (or destructor) removes the segment's name, so the reader must attach before then, it keeps reading entries already saved through its own mapping. One writer and one reader per ring. @param slots number of entry slots, 0 to attach as the reader @param slot_size largest serialised entry (and header) in bytes
+    void SetRingTimeout(int timeout_ms){ m_ring_timeout=timeout_ms; } ///< how long shared_memory Initnew, Save and GetEntry wait for the other process @param timeout_ms time in milliseconds, negative to wait indefinitely
+    void SetCompressionThreads(unsigned int threads){ output.SetCompressionThreads(threads); } ///< number of threads used to compress block_compressed frames as they are saved and post_pre_compress files on Close. Files written with more than one thread remain readable by this class but post_pre_compress ones are concatenated zlib streams. The threads are started here and reused for every save @param threads number of threads, 1 for the original single threaded behaviour
     
     std::string GetVersion();
     
+    /**
+       Declares a secondary index on a key, so entries can be found by the key's value with Query without reading them. Call after Initnew, entries already in the file are indexed straight away by reading just the key from each, the loaded entry is left as it is. The index is kept up to date by Save and DeleteEntry and stored with the lookup table when the file is closed, so reopening the file restores it.
+       @param key The key to index.
+       @return false if an index of another type exists for the key or the existing entries cant be read.
+    */
+    template<typename T> bool AddIndex(const std::string& key){
+      static_assert(std::is_arithmetic<T>::value, "BStore indexes require an arithmetic type");
+      return AddIndex(key, typeid(T).name());
+    }
+    bool AddIndex(const std::string& key, const std::string& type); ///< Declares a secondary index on a key by the typeid name of its values, see the templated AddIndex. @param key The key to index. @param type typeid name of an arithmetic type
+    void RemoveIndex(const std::string& key){ m_indexes.erase(key); } ///< Drops the index of a key. @param key The indexed key.
+    bool HasIndex(const std::string& key) const { return m_indexes.count(key)>0; } ///< Whether a key is indexed. @param key The key.
+    
+    /**
+       Finds the entries whose value of an indexed key lies in a range.
+       @param key The indexed key.
+       @param min Smallest value to match.
+       @param max Largest value to match.
+       @param entries Filled with the matching entry numbers in entry order.
+       @return false if the key has no index of type T.
+    */
+    template<typename T> bool Query(const std::string& key, T min, T max, std::vector<unsigned int>& entries){
+      static_assert(std::is_arithmetic<T>::value, "BStore indexes require an arithmetic type");
+      return QueryIndex(key, typeid(T).name(), IndexKey(min), IndexKey(max), entries);
+    }
+    
+    /**
+       Finds the entries whose value of an indexed key equals a value.
+       @param key The indexed key.
+       @param value Value to match.
+       @param entries Filled with the matching entry numbers in entry order.
+       @return false if the key has no index of type T.
+    */
+    template<typename T> bool Query(const std::string& key, T value, std::vector<unsigned int>& entries){ return Query(key, value, value, entries); }
+    
     
     std::map<std::string,BinaryStream> m_variables;
-    std::map<std::string,std::string> m_type_info;
+    std::map<std::string,std::string> m_type_info; ///< typeid name of each key. Change it through Set, Remove and Delete so the cached ids used by type checks stay in step
     // std::map<std::string,BinaryStream> m_header;
     BStore* Header; 
     std::map<std::string,PointerWrapperBase*> m_ptrs;
@@ -79,11 +382,12 @@ namespace ToolFramework{
     bool Print();
     void Print(bool values); ///< Prints the contents of the BoostStore. @param values If true values and keys are printed. If false just keys are printed
     void Delete(); ///< Deletes all entries in the BoostStore.
-    void Remove(std::string key); ///< Removes a single entry from the BoostStore. @param key The key of the entry to remove. 
-    std::string Type(std::string key); ///< Queries the type of an entry if type checking is turned on. @param key The key of the entry to check. @return A string encoding the type info.
-    bool Has(std::string key); ///< Queries if entry exists in a BoostStore. @param key is the key of the varaible to look up. @return true if varaible is present in the store, false if not. 
+    void Remove(const std::string& key); ///< Removes a single entry from the BoostStore. @param key The key of the entry to remove. 
+    std::string Type(const std::string& key); ///< Queries the type of an entry if type checking is turned on. @param key The key of the entry to check. @return A string encoding the type info.
+    bool Has(const std::string& key); ///< Queries if entry exists in a BoostStore. @param key is the key of the varaible to look up. @return true if varaible is present in the store, false if not. 
     //  BoostStore *Header; ///< Pointer to header BoostStore (only available in multi event BoostStore). This can be used to access and assign header varaibles jsut like a standard non multi event store.
     bool TypeChecking() const { return m_type_checking; }; ///< Whether type checking is enabled (required for JSON serialisation)
+    bool CheckType(const std::string& name, const char* type) const { std::map<std::string,std::string>::const_iterator it=m_type_info.find(name); return it!=m_type_info.end() && it->second==type; } ///< Whether a key was stored with the given type name. @param name key @param type typeid name to compare to
     
     /**
        Templated getter function for BoostStore content. Assignment is templated and via reference.
@@ -91,40 +395,130 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and false if not or wrong type.
     */
-    template<typename T> bool Get(std::string name,T &out){
+    /**
+       Templated getter function using a key handle, avoiding the key lookup when the same key is read repeatedly.
+       @param key Handle for the key, resolved on first use.
+       @param out The variable to fill with the value.
+       @return Return value is true if varaible exists in the Store and false if not or wrong type.
+    */
+    template<typename T> bool Get(KeyHandle& key, T &out){
       
-      if(m_variables.count(name)>0){
-	
-	if(m_type_info[name]==typeid(out).name() || !m_type_checking){
-	  
-	  m_variables[name].m_pos=0;
-	  return m_variables[name] >> out;
-	  
+      if(!m_held.empty() && m_held.count(key.name)) return Get(key.name, out);
+      if(!Resolve(key, false)) return false;
+      if(m_type_checking && !CheckType(key, typeid(out))) return false;
+      
+      key.value->second.m_pos=0;
+      return key.value->second >> out;
+      
+    }
+    
+    template<typename T> bool Get(const std::string& name,T &out){
+      
+      if(!m_held.empty()){
+	std::map<std::string,HeldValueBase*>::iterator held=m_held.find(name);
+	if(held!=m_held.end()){
+	  if(held->second->Type()==typeid(T)) return CopyHeld(out, held->second, Holdable<T>());
+	  if(!Materialise(held)) return false; // read as another type from its serialised form
 	}
-	else return false;
       }
       
-      else return false;
+      std::map<std::string,BinaryStream>::iterator it=m_variables.find(name);
+      if(it==m_variables.end()){
+	if(!LazyLoad(name)) return false;
+	it=m_variables.find(name);
+      }
+      
+      if(m_type_checking && !CheckType(name, typeid(out))) return false;
+      
+      it->second.m_pos=0;
+      return it->second >> out;
+      
+    }
+    
+    /**
+       Templated getter function for a zero copy view of stored strings and vectors of trivially copyable types. The view points into the stored value so it is only valid until the key is next Set, removed, or the entry is changed with GetEntry/Delete.
+       @param name The ASCII key that the variable in the BoostStore is stored with.
+       @param out The view to point at the value. Use BinaryView<char> for strings.
+       @return Return value is true if varaible exists in the Store and false if not or wrong type.
+    */
+    template<typename T> bool Get(const std::string& name, BinaryView<T> &out){
+
+      if(!m_held.empty()){
+	std::map<std::string,HeldValueBase*>::iterator held=m_held.find(name);
+	if(held!=m_held.end() && !Materialise(held)) return false;
+      }
+      
+      std::map<std::string,BinaryStream>::iterator it=m_variables.find(name);
+      if(it==m_variables.end()){
+	if(!LazyLoad(name)) return false;
+	it=m_variables.find(name);
+      }
+
+      if(m_type_checking && !CheckType(name, typeid(std::vector<T>)) && !(typeid(T)==typeid(char) && CheckType(name, typeid(std::string)))) return false;
+
+      it->second.m_pos=0;
+      return it->second >> out;
+
+    }
+
+    /**
+       Templated getter function for one key across every entry in the BStore, in entry order. For columnar files each group's values for the key are read in one sequential pass, other layouts read each entry's key through its key directory. The loaded entry is left as it is.
+       @param name The ASCII key that the variables are stored with.
+       @param out Vector filled with one value per entry, default constructed where an entry doesnt have the key.
+       @return Return value is false if the values cant be read or are the wrong type.
+    */
+    template<typename T> bool GetColumn(const std::string& name, std::vector<T> &out){
+      
+      std::string data;
+      std::vector<uint64_t> sizes;
+      std::vector<std::string> types;
+      if(!ReadColumn(name, data, sizes, types)) return false;
+      
+      out.clear();
+      out.resize(sizes.size());
+      BinaryStream values;
+      values.buffer.swap(data);
+      uint64_t pos=0;
+      for(size_t i=0; i<sizes.size(); i++){
+	if(sizes[i]==COLUMN_MISSING) continue;
+	if(m_type_checking && types[i]!=typeid(T).name()) return false;
+	values.m_pos=pos;
+	if(!(values >> out[i])) return false;
+	pos+=sizes[i];
+      }
       
+      return true;
     }
     
     /**
-       Templated getter function for pointer to BoostStore content. Assignment is templated and the object is created on first the heap and a pointer to it assigned. Latter requests will return a pointer to the first object. Bote the pointer is to an indipendant instance of the stored object and so changing its value without using a Setter will not effect the stored value. 
+       Templated getter function for pointer to BoostStore content. Assignment is templated and the object is created on first the heap and a pointer to it assigned. Latter requests will return a pointer to the first object. Bote the pointer is to an indipendant instance of the stored object and so changing its value without using a Setter will not effect the stored value. The exception is a value held in in memory mode, where the pointer is to the held object itself, so changes are saved, and is valid until the key is next Set with another type, removed, or the entry is changed with GetEntry/Delete.
        @param name The ASCII key that the variable in the BoostStore is stored with.
        @param out The pointer to assign.
        @return Return value is true if varaible exists in the Store and false if not or wrong type.
     */
-    template<typename T> bool Get(std::string name,T* &out){  
+    template<typename T> bool Get(const std::string& name,T* &out){  
       
-      if(m_variables.count(name)>0 || m_ptrs.count(name)>0){
-	if((m_type_info[name]==typeid(T).name() || !m_type_checking ) || (m_ptrs.count(name)>0 && m_variables.count(name)==0)){
+      if(!m_held.empty() && m_ptrs.count(name)==0){
+	std::map<std::string,HeldValueBase*>::iterator held=m_held.find(name);
+	if(held!=m_held.end()){
+	  if(held->second->Type()==typeid(T)){
+	    held->second->dirty=true; // may be changed through the pointer
+	    out=&static_cast<HeldValue<T>*>(held->second)->value;
+	    return true;
+	  }
+	  if(!Materialise(held)) return false;
+	}
+      }
+      
+      if(m_variables.count(name)>0 || m_ptrs.count(name)>0 || LazyLoad(name)){
+	if((!m_type_checking || CheckType(name, typeid(T))) || (m_ptrs.count(name)>0 && m_variables.count(name)==0)){
 	  
 	  bool ret=true;
 	  if(m_ptrs.count(name)==0){
 	    
 	    T* tmp=new T;
 	    m_ptrs[name]=new PointerWrapper<T>(tmp);
-	    ret*=Get(name,*tmp);
+	    ret = Get(name,*tmp) && ret;
 	  }
 	  
 	  
@@ -148,24 +542,90 @@ namespace ToolFramework{
        @param name The key to be used to store and reference the variable in the BoostStore.
        @param in the varaible to be stored.
     */
-    template<typename T> bool Set(std::string name,T& in){
+    /**
+       Templated setter function using a key handle, avoiding the key lookup when the same key is written repeatedly.
+       @param key Handle for the key, resolved on first use.
+       @param in the varaible to be stored.
+    */
+    template<typename T> bool Set(KeyHandle& key, T& in){
+      
+      if(m_in_memory && Holdable<typename std::remove_const<T>::type>::value) return Hold<typename std::remove_const<T>::type>(key.name, in, Holdable<typename std::remove_const<T>::type>());
+      if(!m_held.empty()) Release(key.name);
+      if(!Resolve(key, true)) return false;
+      BinaryStream& stream=key.value->second;
+      stream.Reset();
+      if(!m_directory.empty()) m_directory.erase(key.name);
+      bool ret=stream << in;
+      if(m_type_checking) SetType(key, typeid(in));
+      
+      return ret;
+    }
+    
+    template<typename T> bool Set(const std::string& name,T& in){
       //std::cout<<"in set"<<std::endl;
-      m_variables[name].buffer.clear();
-      m_variables[name].m_pos=0;
+      if(m_in_memory && Holdable<typename std::remove_const<T>::type>::value) return Hold<typename std::remove_const<T>::type>(name, in, Holdable<typename std::remove_const<T>::type>());
+      if(!m_held.empty()) Release(name);
+      BinaryStream& stream=m_variables[name];
+      stream.Reset();
+      m_directory.erase(name);
       //std::cout<<"set serialising"<<std::endl;
-      bool ret=m_variables[name] << in;
+      bool ret=stream << in;
       //std::cout<<"set serialised ="<<ret<<std::endl;
-      if(m_type_checking) m_type_info[name]=typeid(in).name();
+      if(m_type_checking) SetType(name, typeid(in));
       
       return ret;
     }
     
+    /**
+       Templated setter function for temporaries and values passed with std::move. In in memory mode the value is moved into the store, otherwise it is serialised as for other Sets.
+       @param name The key to be used to store and reference the variable in the BoostStore.
+       @param in the varaible to be stored.
+    */
+    template<typename T> typename std::enable_if<!std::is_reference<T>::value && !std::is_pointer<T>::value, bool>::type Set(const std::string& name, T&& in){
+      
+      if(m_in_memory && Holdable<typename std::remove_const<T>::type>::value) return Hold<typename std::remove_const<T>::type>(name, std::move(in), Holdable<typename std::remove_const<T>::type>());
+      return Set(name, in);
+      
+    }
+    
+    /**
+       Templated setter function constructing the value in place from the given arguments. In in memory mode the value is constructed directly in the store, otherwise a temporary is constructed and serialised.
+       @param name The key to be used to store and reference the variable in the BoostStore.
+       @param args the arguments to construct the variable from.
+    */
+    template<typename T, typename... Args> bool Emplace(const std::string& name, Args&&... args){
+      
+      if(!m_in_memory){
+	T tmp(std::forward<Args>(args)...);
+	return Set(name, tmp);
+      }
+      
+      std::map<std::string,HeldValueBase*>::iterator it=m_held.lower_bound(name);
+      if(it!=m_held.end() && it->first==name){
+	HeldValueBase* old=it->second;
+	it->second=new HeldValue<T>(std::forward<Args>(args)...); // args may refer to the old value
+	delete old;
+      }
+      else m_held.insert(it, std::make_pair(name, static_cast<HeldValueBase*>(new HeldValue<T>(std::forward<Args>(args)...))));
+      if(!m_directory.empty()) m_directory.erase(name);
+      
+      return true;
+    }
+    
     /**
        Returns string pointer to Store element.
        @param key The key of the string pointer to return.
        @return a pointer to the string version of the value within the Store.
     */  
-    BinaryStream* operator[](std::string key){
+    BinaryStream* operator[](const std::string& key){
+      if(!m_held.empty()){
+	std::map<std::string,HeldValueBase*>::iterator held=m_held.find(key);
+	if(held!=m_held.end()){
+	  Materialise(held);
+	  Release(key); // the stream may be written to
+	}
+      }
+      LazyLoad(key);
       return &m_variables[key];
     }
     
@@ -175,7 +635,7 @@ namespace ToolFramework{
        @param in A pointer to the object to be stored. The function will store the value the pointer poitns to in the archive and keep hold of the pointer to return to Get calls later.
        @param persist Indicates if the object that is being pointed to is stored or not. If not only the pointer is retained for later use but not in the archive and so will not be saved with the BoostStore on save calls.
     */
-    template<typename T> bool Set(std::string name,T* in, bool persist=true){
+    template<typename T> bool Set(const std::string& name,T* in, bool persist=true){
       
       bool ret=true;
       
@@ -205,6 +665,7 @@ namespace ToolFramework{
     */
     template<typename T> void operator>>(T& obj){
       
+      Materialise();
       std::stringstream stream;
       stream<<"{";
       bool first=true;
@@ -223,7 +684,8 @@ namespace ToolFramework{
     
     //    std::map<unsigned int, unsigned int> m_lookup; //why is this a map?? should change it when you ahve had more sleep
     
-    std::vector<unsigned int> m_lookup;
+    std::vector<uint64_t> m_lookup;
+    std::vector<uint64_t> m_directories; ///< file position of each entry's key directory, 0 if the entry has none. For columnar files the entry's row within its group
     
     BinaryStream output;
     
@@ -231,19 +693,19 @@ namespace ToolFramework{
     
     
     
-    unsigned int m_file_end;
+    unsigned long int m_file_end;
     std::string m_file_name;
-    unsigned int m_open_file_end;
-    unsigned int m_previous_file_end;
+    unsigned long int m_open_file_end;
+    uint64_t m_previous_file_end;
     enum_type m_type;
     bool m_type_checking;
     bool m_has_header;
-    unsigned int m_header_start;
+    uint64_t m_header_start;
     
-    unsigned int m_flags_start;
+    unsigned long int m_flags_start;
     
     
-    unsigned int m_lookup_start;
+    uint64_t m_lookup_start;
     //unsigned int m_lookup_size;
     
     //  std::map<unsigned int, unsigned int> m_lookup;
@@ -253,12 +715,137 @@ namespace ToolFramework{
     
     //int m_file_type; //0=gzopen, 1=fopen, 2=stringstream
     float m_version;
+    float m_file_version; ///< version of the last flags read, older files store 32 bit offsets
+    bool m_lazy; ///< if GetEntry defers reading values until they are accessed
+    std::map<std::string,KeyLocation> m_directory; ///< locations of the current entry's keys not yet read in lazy mode
+    unsigned int m_column_rows; ///< entries per group in columnar files
+    std::vector<ColumnRow> m_pending; ///< entries saved to a columnar file whose group has not been written
+    std::map<std::string,ColumnChunk> m_columns; ///< chunk headers of the loaded columnar group
+    uint64_t m_group_start; ///< file position of the loaded columnar group's directory, 0 if none
+    std::string m_group_data; ///< all values of the loaded columnar group, read when whole entries are needed so rows dont seek between chunks
+    uint64_t m_group_data_start; ///< file position of the first byte of m_group_data
+    unsigned int m_prefetch_depth; ///< entries to read ahead, 0 for no prefetching
+    bool m_prefetch_sequential; ///< if the prefetcher waits for sequential access before starting
+    long int m_last_entry; ///< last entry requested from GetEntry, -1 if none
+    Prefetcher* m_prefetcher; ///< running read ahead, 0 if none
+    enum_codec m_codec;
+    int m_codec_level;
+    bool m_journaled; ///< if saves are recorded in a journal
+    FILE* m_journal; ///< open journal, 0 if none
+    BinaryStream m_journal_entry; ///< journaled entries are serialised here before being written so their checksum is taken from memory
+    bool m_closed; ///< set by Close once the file is closed, so Close and opening an existing file with Initnew dont close it again
+    std::thread m_compact_thread; ///< background compaction, not joinable if none is running
+    bool m_compact_ok; ///< result of the last compaction, set by the compaction thread so only read after JoinCompact
+    std::string m_compact_name; ///< file being compacted into, "" if no compaction is waiting for CompactWait
+    bool m_compact_in_place; ///< if the compacted file replaces this store's file
+    unsigned long int m_compact_file_end; ///< m_file_end when compaction started, to detect saves made since
+    size_t m_compact_entries; ///< entries being compacted
+    unsigned int m_batch_entries; ///< entries per batch, 0 if saves are not batched
+    unsigned long int m_batch_bytes; ///< batch size in bytes at which it is written early
+    BinaryStream m_batch; ///< serialised entries waiting to be written at m_file_end
+    std::vector<std::string> m_names; ///< dictionary of the key and type names used in the file's type info, entries store indices into it
+    std::unordered_map<std::string,uint32_t> m_name_ids; ///< index of each name in m_names
+    uint32_t m_names_written; ///< names of m_names already written to the file, later ones are written with the next entry's type info
+    std::unordered_map<const std::type_info*,uint32_t> m_type_name_ids; ///< dictionary id of each type checked or set so far
+    std::map<std::string,uint32_t> m_type_ids; ///< dictionary id of the type of keys in m_type_info, filled as keys are set, read or checked so type checks compare ids. Only valid for m_type_ids_generation
+    uint64_t m_type_ids_generation; ///< m_generation m_type_ids was filled for, it is emptied once the generation moves on
+    uint64_t m_generation; ///< changed whenever values may have been erased so KeyHandles look their key up again, unique across all stores
+    std::vector<JournalRecord> m_batch_records; ///< position of each entry in m_batch, used for the journal
+    bool m_in_memory; ///< if Set keeps typed values instead of serialising them
+    std::map<std::string,ValueIndex> m_indexes; ///< secondary indexes by key
+    std::shared_ptr<char> m_ring; ///< mapping of a shared_memory store's segment, starting with a RingHeader
+    unsigned long int m_ring_size; ///< bytes mapped
+    unsigned int m_ring_slots; ///< slots to create, 0 to attach as the reader
+    unsigned long int m_ring_slot_size; ///< bytes per slot
+    int m_ring_timeout; ///< milliseconds to wait for the other process, negative for no limit
+    bool m_ring_writer; ///< if this store created the segment
+    uint64_t m_ring_header_sequence; ///< header_sequence of the header last read
+    std::map<std::string,HeldValueBase*> m_held; ///< values kept as typed objects in in memory mode, these take precedence over m_variables which is only updated when they are serialised
+    
+    unsigned int FlagsSize(float version); ///< size in bytes of the flags block for a given file version
+    bool ReadOffset(uint64_t& offset, float version); ///< reads a file offset from the flags, 32 bit before version 3
+    bool LazyLoad(const std::string& name); ///< reads a key of a lazily loaded entry into m_variables @return false if the key is not waiting in the directory or cant be read
+    bool FlushColumns(); ///< writes the pending entries of a columnar file as a group
+    bool WriteEntry(BinaryStream& stream, uint64_t base, uint64_t& directory_start); ///< serialises m_variables, m_type_info and the key directory @param stream stream to write to @param base file position of the stream's start @param directory_start set to the file position of the key directory
+    bool FlushBatch(); ///< writes any batched entries to file
+    uint32_t NameId(const std::string& name); ///< index of a name in the dictionary, adding it if new
+    bool Resolve(KeyHandle& key, bool create); ///< makes sure a handle points at its key's value @param create if the value should be added when missing @return false if the key is not in the store
+    uint32_t TypeId(const std::type_info& type); ///< dictionary id of a type's name
+    void SyncTypeIds(); ///< empties m_type_ids if m_type_info may have been replaced since it was filled
+    std::map<std::string,uint32_t>::iterator FindTypeId(const std::string& name); ///< the dictionary id of a key's type, looked up from m_type_info if not known yet @return m_type_ids.end() if the key has no type info
+    bool CheckType(const std::string& name, const std::type_info& type); ///< whether a key was stored with the given type, comparing dictionary ids
+    bool CheckType(KeyHandle& key, const std::type_info& type); ///< whether a resolved key was stored with the given type, comparing dictionary ids
+    void SetType(const std::string& name, const std::type_info& type); ///< records the type of a key
+    void SetType(KeyHandle& key, const std::type_info& type); ///< records the type of a resolved key
+    bool WriteTypeInfo(BinaryStream& stream); ///< writes m_type_info as dictionary ids, preceded by any names first used by this entry
+    bool ReadTypeInfo(BinaryStream& stream); ///< reads an entry's type info into m_type_info, adding names the dictionary doesnt have yet
+    bool ReadJournal(const std::string& filename, uint64_t& base, uint64_t& end, bool& header, bool& type_checking, std::vector<JournalRecord>& records); ///< reads and checks the journal of an unclosed file, dropping records whose data did not reach the file @param base file end when journaling started @param end end of the last good entry @param header @param type_checking settings of the file when journaling started
+    bool OpenJournal(); ///< starts or continues the journal of the open file
+    bool WriteJournal(unsigned int entry, uint64_t offset, uint64_t length, uint64_t directory, uint32_t checksum, bool flush=true); ///< appends a record @param checksum JournalChecksum of the entry's bytes as written @param flush if the file and journal should be flushed and synced to disk after the record
+    void CloseJournal(bool remove); ///< closes the journal @param remove true if the file has been closed cleanly so the journal is no longer needed
+    void JoinCompact(); ///< waits for any background compaction thread
+    bool StartPrefetch(unsigned int entry); ///< starts the read ahead thread from the given entry @return false if the file cant be read ahead
+    void StopPrefetch(); ///< stops and joins any read ahead thread
+    bool TakePrefetched(unsigned int entry); ///< swaps a read ahead entry into m_variables, repositioning the reader if it isnt the one asked for @return false if the entry has to be read directly
+    bool Materialise(); ///< serialises any held values changed since they were last serialised into m_variables
+    bool Materialise(std::map<std::string,HeldValueBase*>::iterator held); ///< serialises one held value into m_variables if it has changed
+    void Release(const std::string& name); ///< deletes the held value of a key, if any, leaving m_variables as it is
+    
+    /**
+       Keeps a typed copy of a value in in memory mode, reusing the existing holder when the key is set again with the same type.
+       @param name The key.
+       @param in The value to copy, or move if passed as an rvalue.
+    */
+    template<typename T, typename U> bool Hold(const std::string& name, U&& in, std::true_type){
+      
+      std::map<std::string,HeldValueBase*>::iterator it=m_held.lower_bound(name);
+      if(it!=m_held.end() && it->first==name){
+	if(it->second->Type()==typeid(T)){
+	  HeldValue<T>* held=static_cast<HeldValue<T>*>(it->second);
+	  if(static_cast<const void*>(&held->value)!=static_cast<const void*>(&in)) held->value=std::forward<U>(in); // a key set to its own value is left as it is
+	  held->dirty=true;
+	}
+	else{
+	  HeldValueBase* old=it->second;
+	  it->second=new HeldValue<T>(std::forward<U>(in)); // in may be part of the old value
+	  delete old;
+	}
+      }
+      else m_held.insert(it, std::make_pair(name, static_cast<HeldValueBase*>(new HeldValue<T>(std::forward<U>(in)))));
+      if(!m_directory.empty()) m_directory.erase(name);
+      
+      return true;
+    }
+    template<typename T, typename U> bool Hold(const std::string& name, U&& in, std::false_type){ return false; } ///< values that cant be copied are never held
+    template<typename T> static bool CopyHeld(T& out, HeldValueBase* held, std::true_type){ out=static_cast<HeldValue<T>*>(held)->value; return true; } ///< copies a held value out @param out variable to fill @param held holder of a value of type T
+    template<typename T> static bool CopyHeld(T& out, HeldValueBase* held, std::false_type){ return false; } ///< values that cant be copied are never held
+
+    bool FillIndex(const std::string& key, ValueIndex& index); ///< indexes the key's values in all entries already saved
+    void UpdateIndexes(unsigned int entry); ///< records the indexed keys' values of m_variables as those of an entry
+    bool QueryIndex(const std::string& key, const char* type, uint64_t min, uint64_t max, std::vector<unsigned int>& entries); ///< entries whose encoded value of the key is in the range
+    bool WriteIndexes(); ///< writes the indexes after the type dictionary
+    bool ReadIndexes(); ///< reads the indexes written by WriteIndexes
+    bool OpenRing(const std::string& name, bool header, bool type_checking); ///< creates or attaches to a shared_memory store's segment
+    bool CloseRing(); ///< marks this side as closed and unmaps the segment, removing it if this is the reader
+    bool SaveRing(); ///< serialises m_variables into the next slot once the reader has moved past it
+    bool GetRingEntry(unsigned int entry, uint64_t& directory); ///< points output at an entry's slot once it has been saved @param directory set to the position of the entry's key directory
+    bool WriteRingHeader(); ///< copies the serialised header into the segment
+    bool GetRingHeader(); ///< reads the header from the segment
+    bool RingWait(const std::function<bool()>& ready); ///< waits for the other process until ready returns true, blocking on the ring's futex once mapped and polling every 100us for the segment to appear before that @return false if timed out
+    void RingNotify(); ///< wakes the other process if it is waiting in RingWait, call after changing anything it may wait for
+    RingHeader* GetRingHeaderArea(char*& area); ///< segment's RingHeader @param area set to the start of the header area
+    RingSlot* GetRingSlot(uint64_t entry); ///< slot an entry is written to
+    
+    bool LoadGroup(uint64_t group_start); ///< reads the directory and chunk headers of a columnar group
+    bool LoadGroupData(); ///< reads the values of the loaded columnar group into m_group_data
+    bool ReadColumn(const std::string& name, std::string& data, std::vector<uint64_t>& sizes, std::vector<std::string>& types); ///< gathers the serialised values of a key across all entries @param data the present values back to back @param sizes each entry's value size or COLUMN_MISSING @param types each entry's type when type checking
     
     bool (*GetJsonEncoder(const std::string& key) const)(std::ostream&, const BinaryStream&);
     
   };
 
   bool json_encode(std::ostream&, const BStore&);
+  bool ReadTypeInfo(BinaryStream& stream, std::map<std::string,std::string>& type_info, const std::vector<std::string>& names, std::vector<std::string>* extend=0, std::map<std::string,uint32_t>* type_ids=0); ///< reads an entry's type info written as dictionary ids or, for older entries, as a map of strings @param names the file's type dictionary @param extend if not 0 receives names first used by this entry when they follow on from names @param type_ids if not 0 receives the dictionary id of each type that is in names
 }
 
 #endif
@@ -272,11 +859,14 @@ namespace ToolFramework{
   /////////////////////////////////////////////////////////////////
   /// entry 0                                      
   /// *entry 0 type_info
+  /// entry 0 key directory
   /// entry 1 
   /// entry 1 
   /// entry 1 extra data for nesting 
+  /// entry 1 key directory
   /// entry 2 
   /// *entry 2 type_info
+  /// entry 2 key directory
   /// ..
   /// ..
   /// Header                                          :  m_header_start
@@ -284,14 +874,48 @@ namespace ToolFramework{
   /// lookup 1 
   /// ..
   /// ..
-  /// m_version                                       :  m_flags_start    #here down always uncompressed
-  /// m_header_start                                  
+  /// directory lookup 0
+  /// directory lookup 1
+  /// ..
+  /// ..
+  /// type dictionary (key and type names)
+  /// number of indexes, then for each: key, type name, encoded value of each entry, if each entry has the value
+  /// m_header_start                                :  m_flags_start    #here down always uncompressed
   /// m_has_header
   /// m_lookup_start
   /// m_type_checking
   /// m_type   
   /// m_previous_file_end
+  /// m_codec
+  /// m_version
+  /// BSTORE_FLAGS_MAGIC
   //////////////////////////////////////////////////  :  m_file_end  m_open_file_end
+  ///
+  /// version 1 files have m_version first and no m_codec or magic number
+  /// columnar files replace the entries with groups of
+  /// key 0 ColumnChunk sizes, types, then each row's value
+  /// key 1 ColumnChunk ..
+  /// group directory (key to chunk position)
+  /// and the lookup and directory lookup hold each entry's group directory and row
+  ///
+  /// *type_info is TYPE_DICTIONARY_MARKER, first new dictionary index, names first used by the entry, then key and type index pairs
+  /// before version 6 there are no indexes
+  /// before version 5 type_info is a map of key to type name strings and there is no type dictionary
+  /// before version 4 there are no key directories or directory lookup
+  /// before version 3 m_header_start, m_lookup_start, m_previous_file_end and the lookup entries are 32 bit
+  ///
+  /// shared_memory stores have no file, their segment is
+  /// RingHeader
+  /// header (serialised Header->m_variables)
+  /// RingSlot 0, entry (as above but with type_info as a map of key to type name strings and positions relative to the slot)
+  /// RingSlot 1, entry
+  /// ..
+  ///
+  /// journaled files also have filename.journal until closed
+  /// BSTORE_JOURNAL_MAGIC, file end when journaling started, m_has_header, m_type_checking
+  /// JournalRecord 0 (entry, offset, length, directory, checksum)
+  /// JournalRecord 1
+  /// ..
 
 
 
@@ -0,0 +1,89 @@
+#include <BStoreReader.h>
+#include <algorithm>
+
+using namespace ToolFramework;
+
+BStoreReader::BStoreReader(){
+
+  m_stream=0;
+  m_type_checking=false;
+
+}
+
+bool BStoreReader::Init(BStore& store){
+
+  m_stream=0;
+  m_lookup.clear();
+  m_ends.clear();
+  Header.reset();
+
+  if(store.m_type==compressed || store.m_type==columnar || store.m_type==shared_memory || store.output.m_endpoint==COMPRESSED){
+    std::clog<<"ERROR BStoreReader::Init : compressed, columnar and shared_memory stores cant be read with positioned reads"<<std::endl;
+    return false;
+  }
+  if(!store.FlushBatch()){
+    std::clog<<"ERROR BStoreReader::Init : Error writing batched entries"<<std::endl;
+    return false;
+  }
+  if(store.output.pfile!=0) fflush(store.output.pfile); // make buffered writes visible to pread
+
+  m_lookup=store.m_lookup;
+  m_type_checking=store.m_type_checking;
+  m_names=store.m_names;
+  if(store.m_has_header && store.Header!=0) Header.reset(new BStore(*store.Header));
+
+  // an entry ends at the next thing written after it, anything beyond its data is left unread
+  std::vector<uint64_t> starts(m_lookup);
+  starts.push_back(store.m_header_start);
+  starts.push_back(store.m_lookup_start);
+  starts.push_back(store.m_file_end);
+  std::sort(starts.begin(), starts.end());
+  m_ends.resize(m_lookup.size());
+  for(size_t i=0; i<m_lookup.size(); i++){
+    std::vector<uint64_t>::iterator next=std::upper_bound(starts.begin(), starts.end(), m_lookup[i]);
+    m_ends[i]= next==starts.end() ? m_lookup[i] : *next;
+  }
+
+  m_stream=&store.output;
+
+  return true;
+}
+
+bool BStoreReader::GetEntry(unsigned int entry_request, BStore& out) const{
+
+  if(m_stream==0){
+    std::clog<<"ERROR BStoreReader::GetEntry : reader not initialised"<<std::endl;
+    return false;
+  }
+  if(entry_request>=m_lookup.size()){
+    std::clog<<"ERROR BStoreReader::GetEntry : Entry outside of range"<<std::endl;
+    return false;
+  }
+
+  out.Delete();
+  out.m_type_checking=m_type_checking;
+
+  unsigned long int size=m_ends[entry_request]-m_lookup[entry_request];
+  BinaryStream entry(RAM);
+  entry.buffer.resize(size);
+  if(m_stream->Bpread(&entry.buffer[0], size, m_lookup[entry_request])!=size){
+    std::clog<<"ERROR BStoreReader::GetEntry : Error reading entry"<<std::endl;
+    return false;
+  }
+  if(!(entry >> out.m_variables)){
+    std::clog<<"ERROR BStoreReader::GetEntry : Error reteriving entry varaibles"<<std::endl;
+    return false;
+  }
+  if(m_type_checking && !ReadTypeInfo(entry, out.m_type_info, m_names)){
+    std::clog<<"ERROR BStoreReader::GetEntry : Error reteriving m_type_info"<<std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+unsigned int BStoreReader::NumEntries() const{
+
+  return m_lookup.size();
+
+}
@@ -0,0 +1,42 @@
+#ifndef BSTOREREADER_H
+#define BSTOREREADER_H
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <BStore.h>
+
+namespace ToolFramework{
+  
+  /**
+   * \class BStoreReader
+   *
+   * Read only handle on an open BStore file that several threads can use at once. It takes a copy of the store's lookup table, type dictionary and header when initialised and reads entries with positioned reads through the store's own file handle, so worker threads can each fill their own BStore without opening the file again. The BStore must stay open and must not be saved to while readers are in use. Compressed and columnar files are not supported.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  class BStoreReader{
+    
+  public:
+    
+    BStoreReader();
+    bool Init(BStore& store); ///< take a snapshot of the store's lookup and header, call again to pick up entries saved since @param store open BStore to read from @return false if the store's file type cant be read this way
+    bool GetEntry(unsigned int entry_request, BStore& out) const; ///< read an entry into out, safe to call from several threads as long as each uses its own out @param entry_request entry number @param out store to fill, its existing contents are removed @return false on error
+    unsigned int NumEntries() const; ///< number of entries at the time of Init
+    std::shared_ptr<BStore> Header; ///< copy of the store's header shared by all copies of this reader, 0 if the store has none. Only read from it while other threads may be using it
+    
+  private:
+    
+    const BinaryStream* m_stream; ///< stream of the store being read
+    std::vector<uint64_t> m_lookup; ///< file position of each entry
+    std::vector<uint64_t> m_ends; ///< position each entry's data ends by
+    bool m_type_checking; ///< if entries are followed by their type info
+    std::vector<std::string> m_names; ///< the store's type dictionary
+    
+  };
+  
+}
+
+#endif
@@ -1,7 +1,12 @@
 #include <BinaryStream.h>
+#include <algorithm>
+#include <atomic>
 
 using namespace ToolFramework;
 
+static std::atomic<uint64_t> block_open_ids(0); // source of BinaryStream::m_block_open_id
+
+
 BinaryStream::BinaryStream(enum_endpoint endpoint){
 
   m_endpoint=endpoint;
@@ -14,11 +19,19 @@ BinaryStream::BinaryStream(enum_endpoint endpoint){
 #ifdef ZLIB
   gzfile=0;
 #endif
+  m_map_size=0;
+  m_block_size=262144;
+  m_codec=Codec::Default();
+  m_codec_level=-1;
+  m_compression_threads=1;
+  m_block_frame=-1;
+  m_block_open_id=0;
+  m_block_modified=false;
 }
 
 BinaryStream::~BinaryStream(){
 
-  if((m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS) && pfile!=NULL) Bclose(true);
+  if((m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS || m_endpoint==BLOCK_COMPRESSED) && pfile!=NULL) Bclose(true);
 #ifdef ZLIB
   else if(m_endpoint==COMPRESSED && gzfile!=0) Bclose();
 #endif
@@ -31,13 +44,10 @@ std::string BinaryStream::GetVersion(){return "mydata:1.0.0";}
 
 //could put safety on close so cant be called twice, requires some way of recording state of gzfile as cant tell if open or closed (thinking either flag for state or better to use pointer if possible)
 
-//need clear function delete buffer and reset m_pos
-//need reset function for resetting m_pos
-
 //posiblly pfile/gzfile direct initialise will need this for nested stores
 //need direct initialisation form gxfile or pfile given a starting position for nested stores.
 
-bool BinaryStream::Bopen(std::string filename, enum_mode method, enum_endpoint endpoint){//make methods auto from READ WRITE strings (maybe append in future)
+bool BinaryStream::Bopen(std::string filename, enum_mode method, enum_endpoint endpoint, unsigned long int container_end){//make methods auto from READ WRITE strings (maybe append in future)
   //auto to highest endpoint unless specified;
 
   enum_endpoint prev_endpoint=m_endpoint;
@@ -68,7 +78,7 @@ bool BinaryStream::Bopen(std::string filename, enum_mode method, enum_endpoint e
     //std::cout<<"j1 "<<Btell()<<std::endl;
     if(!Bseek(0,SEEK_END)) return false;
     //std::cout<<"j2 "<<Btell()<<std::endl;  
-    unsigned int end= Btell();
+    unsigned long int end= Btell();
     //std::cout<<"j3 end="<<end<<std::endl;
     if(!Bseek(0,SEEK_SET)) return false;
     //std::cout<<"j4"<<std::endl;    
@@ -130,8 +140,8 @@ bool BinaryStream::Bopen(std::string filename, enum_mode method, enum_endpoint e
   else if(m_endpoint==COMPRESSED){
     gzfile=new gzFile;
     if(method==READ) *gzfile = gzopen(m_file_name.c_str(), "rb");
-    else if (method==NEW) *gzfile = gzopen(m_file_name.c_str(), "wb");
-    else if (method==APPEND) *gzfile = gzopen(m_file_name.c_str(), "ab");
+    else if (method==NEW) *gzfile = gzopen(m_file_name.c_str(), (m_codec_level>=0 && m_codec_level<=9) ? ("wb" + std::to_string(m_codec_level)).c_str() : "wb");
+    else if (method==APPEND) *gzfile = gzopen(m_file_name.c_str(), (m_codec_level>=0 && m_codec_level<=9) ? ("ab" + std::to_string(m_codec_level)).c_str() : "ab");
     else {
       delete gzfile;
       gzfile=0;
@@ -141,6 +151,36 @@ bool BinaryStream::Bopen(std::string filename, enum_mode method, enum_endpoint e
     return true;
   }
 #endif
+
+  else if(m_endpoint==BLOCK_COMPRESSED) return BlockOpen(method, container_end);
+
+  else if(m_endpoint==MMAP){
+    if(method!=READ) return false; // mapping is read only
+    m_map.reset(); // drop any earlier mapping so an empty or failed open does not leave it behind
+    m_map_size=0;
+    m_pos=0;
+    int fd = open(m_file_name.c_str(), O_RDONLY);
+    if(fd==-1) return false;
+    struct stat fbuffer;
+    if(fstat(fd, &fbuffer)){
+      close(fd);
+      return false;
+    }
+    m_map_size=static_cast<unsigned long int>(fbuffer.st_size);
+    if(m_map_size){
+      void* map = mmap(0, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(map==MAP_FAILED){
+	close(fd);
+	m_map_size=0;
+	return false;
+      }
+      unsigned long int map_size=m_map_size;
+      m_map.reset(static_cast<char*>(map), [map_size](char* p){ munmap(p, map_size); });
+    }
+    close(fd); // mapping stays valid after the descriptor is closed
+    return true;
+  }
+  
   else{
     m_file_name="";
     return false;
@@ -171,7 +211,8 @@ bool BinaryStream::Bclose(bool Ignore_Post_Pre_compress){
     if(!Ignore_Post_Pre_compress){
       FILE* source = fopen(tmpfile.c_str(), "rb");
       FILE* destination = fopen(m_file_name.c_str(), "wb");
-      def(source, destination, 9); //not sure fo return
+      if(m_compression_threads>1) pdef(source, destination, (m_codec_level>=0 && m_codec_level<=9) ? m_codec_level : 9, CompressionWorkers());
+      else def(source, destination, (m_codec_level>=0 && m_codec_level<=9) ? m_codec_level : 9); //not sure fo return
       if(fclose(source)) return false;
       if(fclose(destination)) return false;
     }
@@ -189,15 +230,27 @@ bool BinaryStream::Bclose(bool Ignore_Post_Pre_compress){
     }
   }
 #endif
+  else if(m_endpoint==MMAP){
+    m_map.reset();
+    m_map_size=0;
+    m_pos=0;
+    return true;
+  }
+  else if(m_endpoint==BLOCK_COMPRESSED) return BlockClose(!Ignore_Post_Pre_compress);
   return false;
   
 }
 
-bool BinaryStream::Bwrite(const void* in, unsigned int size){
+bool BinaryStream::Bwrite(const void* in, unsigned long int size){
 
   if(m_endpoint==RAM){
-    buffer.resize(buffer.length()+size);
-    memcpy(&(buffer[m_pos]), in, size);
+    unsigned long int end=m_pos+size;
+    if(end>buffer.capacity()) buffer.reserve(end > 2*buffer.capacity() ? end : 2*buffer.capacity()); // geometric growth so repeated small writes dont reallocate
+    if(m_pos==buffer.length()) buffer.append(static_cast<const char*>(in), size);
+    else{
+      if(end>buffer.length()) buffer.resize(end); // zero fills any gap if seeked past the end
+      memcpy(&(buffer[m_pos]), in, size); // overwrite in place after a seek
+    }
     m_pos+=size;
     return true;
   }
@@ -205,31 +258,188 @@ bool BinaryStream::Bwrite(const void* in, unsigned int size){
     return fwrite(in , size, 1, pfile);
   } 
 #ifdef ZLIB
-  else if(m_endpoint==COMPRESSED) return size==gzwrite(*gzfile, in, size);
+  else if(m_endpoint==COMPRESSED){
+    const char* data=static_cast<const char*>(in);
+    while(size){ // gzwrite takes an unsigned int length
+      unsigned int chunk= size>1073741824 ? 1073741824 : size;
+      if((int)chunk!=gzwrite(*gzfile, data, chunk)) return false;
+      data+=chunk;
+      size-=chunk;
+    }
+    return true;
+  }
 #endif
+  else if(m_endpoint==BLOCK_COMPRESSED){
+    if(m_pos!=BlockLength()) return false; // frames are append only
+    m_write_block.append(static_cast<const char*>(in), size);
+    m_pos+=size;
+    if(m_write_block.length()>=m_block_size*(m_compression_threads>1 ? m_compression_threads : 1)){ // wait for a frame per thread before compressing
+      unsigned long int written=(m_write_block.length()/m_block_size)*m_block_size;
+      if(!BlockWriteFrames(m_write_block.data(), written)) return false;
+      m_write_block.erase(0, written);
+    }
+    return true;
+  }
+  else if(m_endpoint==MMAP){
+    if(m_mode==READ || m_pos+size>m_map_size) return false; // file mappings are opened READ and are read only
+    memcpy(m_map.get()+m_pos, in, size);
+    m_pos+=size;
+    return true;
+  }
   else return false;
 
 }
 
-bool BinaryStream::Bread(void* out, unsigned int size){
+bool BinaryStream::Bread(void* out, unsigned long int size){
   
   if(m_endpoint==RAM){
+    if(m_pos+size>buffer.length()) return false;
     memcpy(out, &(buffer[m_pos]), size);
     m_pos+=size;
     return true;
   }
   else if(m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS) return fread(out , size, 1, pfile);
 #ifdef ZLIB
-  else if(m_endpoint==COMPRESSED) return size==gzread(*gzfile, out, size);
+  else if(m_endpoint==COMPRESSED){
+    char* data=static_cast<char*>(out);
+    while(size){ // gzread takes an unsigned int length
+      unsigned int chunk= size>1073741824 ? 1073741824 : size;
+      if((int)chunk!=gzread(*gzfile, data, chunk)) return false;
+      data+=chunk;
+      size-=chunk;
+    }
+    return true;
+  }
 #endif
+  else if(m_endpoint==MMAP){
+    if(m_pos+size>m_map_size) return false;
+    memcpy(out, m_map.get()+m_pos, size);
+    m_pos+=size;
+    return true;
+  }
+  else if(m_endpoint==BLOCK_COMPRESSED){
+    unsigned long int framed= m_frames.size() ? m_frames.back().logical_offset+m_frames.back().uncompressed_size : 0;
+    if(m_pos+size>framed+m_write_block.length()) return false;
+    char* dest=static_cast<char*>(out);
+    while(size){
+      unsigned long int chunk=size;
+      if(m_pos>=framed) memcpy(dest, m_write_block.data()+(m_pos-framed), chunk); // not yet written out as a frame
+      else{
+	size_t frame=0;
+	if(m_block_frame>=0 && m_pos>=m_frames[static_cast<size_t>(m_block_frame)].logical_offset && m_pos<m_frames[static_cast<size_t>(m_block_frame)].logical_offset+m_frames[static_cast<size_t>(m_block_frame)].uncompressed_size) frame=static_cast<size_t>(m_block_frame);
+	else frame=static_cast<size_t>(std::upper_bound(m_frames.begin(), m_frames.end(), m_pos, [](unsigned long int pos, const BlockFrame& f){ return pos<f.logical_offset; }) - m_frames.begin()) - 1;
+	if(!BlockLoadFrame(frame)) return false;
+	unsigned long int offset=m_pos-m_frames[frame].logical_offset;
+	if(chunk>m_frames[frame].uncompressed_size-offset) chunk=m_frames[frame].uncompressed_size-offset;
+	memcpy(dest, m_block.data()+offset, chunk);
+      }
+      dest+=chunk;
+      m_pos+=chunk;
+      size-=chunk;
+    }
+    return true;
+  }
   else return false;
   
 }
 
 
-unsigned long int BinaryStream::Btell(){
+/* Last frame decoded by Bpread on one thread. Frames are never rewritten, so a frame is identified by its index and the opening of the stream it was read through */
+struct FrameCache{
+
+  FrameCache(): open_id(0), frame(0){}
+  uint64_t open_id; // m_block_open_id of the stream, 0 if nothing is cached
+  size_t frame; // index of the cached frame
+  std::string compressed; // scratch space for the frame as stored
+  std::string block; // the decompressed frame
+
+};
+
+unsigned long int BinaryStream::Bpread(void* out, unsigned long int size, unsigned long int pos) const{
+
+  char* dest=static_cast<char*>(out);
+
+  if(m_endpoint==RAM || m_endpoint==MMAP){
+    const char* data= m_endpoint==RAM ? buffer.data() : m_map.get();
+    unsigned long int length= m_endpoint==RAM ? buffer.length() : m_map_size;
+    if(pos>=length) return 0;
+    if(size>length-pos) size=length-pos;
+    memcpy(dest, data+pos, size);
+    return size;
+  }
+  else if(m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS){
+    if(pfile==0) return 0;
+    unsigned long int done=0;
+    while(done<size){ // pread may return short counts
+      ssize_t ret=pread(fileno(pfile), dest+done, size-done, static_cast<off_t>(pos+done));
+      if(ret<=0) break;
+      done+=static_cast<unsigned long int>(ret);
+    }
+    return done;
+  }
+  else if(m_endpoint==BLOCK_COMPRESSED){
+    unsigned long int framed= m_frames.size() ? m_frames.back().logical_offset+m_frames.back().uncompressed_size : 0;
+    if(pos>=framed+m_write_block.length()) return 0;
+    if(size>framed+m_write_block.length()-pos) size=framed+m_write_block.length()-pos;
+    unsigned long int done=0;
+    size_t frame=static_cast<size_t>(std::upper_bound(m_frames.begin(), m_frames.end(), pos, [](unsigned long int p, const BlockFrame& f){ return p<f.logical_offset; }) - m_frames.begin()) - 1;
+    static thread_local FrameCache cache; // each reading thread keeps the last frame it decoded so reads from the same frame dont decompress it again
+    while(done<size){
+      if(pos>=framed){ // not yet written out as a frame
+	memcpy(dest+done, m_write_block.data()+(pos-framed), size-done);
+	return size;
+      }
+      const BlockFrame& f=m_frames[frame];
+      if(cache.open_id!=m_block_open_id || cache.frame!=frame){
+	cache.open_id=0;
+	uint8_t codec=0;
+	cache.compressed.resize(f.compressed_size);
+	if(pread(fileno(pfile), &codec, sizeof(codec), static_cast<off_t>(f.file_offset))!=sizeof(codec)) return done;
+	if(f.compressed_size && pread(fileno(pfile), &cache.compressed[0], f.compressed_size, static_cast<off_t>(f.file_offset+sizeof(uint8_t)+2*sizeof(uint32_t)))!=static_cast<ssize_t>(f.compressed_size)) return done;
+	Codec* decompressor=Codec::Get(static_cast<enum_codec>(codec));
+	cache.block.resize(f.uncompressed_size);
+	if(decompressor==0 || !decompressor->Decompress(cache.compressed.data(), f.compressed_size, &cache.block[0], f.uncompressed_size)){
+	  std::clog<<"ERROR BinaryStream::Bpread : cannot decompress frame "<<frame<<std::endl;
+	  return done;
+	}
+	cache.open_id=m_block_open_id;
+	cache.frame=frame;
+      }
+      unsigned long int offset=pos-f.logical_offset;
+      unsigned long int chunk= size-done<f.uncompressed_size-offset ? size-done : f.uncompressed_size-offset;
+      memcpy(dest+done, cache.block.data()+offset, chunk);
+      done+=chunk;
+      pos+=chunk;
+      frame++;
+    }
+    return done;
+  }
   
+  return 0;
+
+}
+
+bool BinaryStream::Bview(const char* &out, unsigned long int size){
+
   if(m_endpoint==RAM){
+    if(m_pos+size>buffer.length()) return false;
+    out=buffer.data()+m_pos;
+    m_pos+=size;
+    return true;
+  }
+  else if(m_endpoint==MMAP){
+    if(m_pos+size>m_map_size) return false;
+    out=m_map.get()+m_pos;
+    m_pos+=size;
+    return true;
+  }
+  else return false;
+  
+}
+
+unsigned long int BinaryStream::Btell(){
+  
+  if(m_endpoint==RAM || m_endpoint==MMAP || m_endpoint==BLOCK_COMPRESSED){
     return m_pos;
   }
   else if(m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS){
@@ -237,13 +447,13 @@ unsigned long int BinaryStream::Btell(){
   }
 #ifdef ZLIB
   else if(m_endpoint==COMPRESSED){
-    return gztell(*gzfile);
+    return static_cast<unsigned long int>(gztell(*gzfile));
   }
 #endif
   else return false;
 }
 
-bool BinaryStream::Bseek(unsigned int pos, int whence){
+bool BinaryStream::Bseek(unsigned long int pos, int whence){
 
   if(m_endpoint==RAM){
     if(whence==SEEK_SET) m_pos=pos;
@@ -252,15 +462,31 @@ bool BinaryStream::Bseek(unsigned int pos, int whence){
     return true;
   }
   else if(m_endpoint==UNCOMPRESSED || m_endpoint==POST_PRE_COMPRESS){
-    if(whence==SEEK_END) return (-1!=lseek(fileno(pfile), pos, whence));
-    else return !fseek(pfile, pos, whence);
+    if(whence==SEEK_END) return (-1!=lseek(fileno(pfile), static_cast<off_t>(pos), whence));
+    else return !fseek(pfile, static_cast<long int>(pos), whence);
   }
 #ifdef ZLIB
   else if(m_endpoint==COMPRESSED){
     if(whence==SEEK_END) return false; // could rewrite to get end pos with fopen and lseek
-    return (-1!=gzseek(*gzfile, pos, whence));
+    return (-1!=gzseek(*gzfile, static_cast<z_off_t>(pos), whence));
   }
 #endif
+  else if(m_endpoint==MMAP){
+    unsigned long int new_pos=pos;
+    if(whence==SEEK_CUR) new_pos+=m_pos;
+    else if(whence==SEEK_END) new_pos+=m_map_size;
+    if(new_pos>m_map_size) return false;
+    m_pos=new_pos;
+    return true;
+  }
+  else if(m_endpoint==BLOCK_COMPRESSED){
+    unsigned long int new_pos=pos;
+    if(whence==SEEK_CUR) new_pos+=m_pos;
+    else if(whence==SEEK_END) new_pos+=BlockLength();
+    if(new_pos>BlockLength()) return false;
+    m_pos=new_pos;
+    return true;
+  }
   else return false;
 }
 
@@ -305,6 +531,203 @@ bool BinaryStream::Serialise(BinaryStream &bs){ // do return properly
   
 }
 
+/* BLOCK_COMPRESSED container layout:
+   frame 0 : codec (uint8 enum_codec), compressed size (uint32), uncompressed size (uint32), data
+   frame 1 ..
+   index   : number of frames (uint64), then per frame file offset (uint64), compressed size (uint32), uncompressed size (uint32)
+   trailer : index start (uint64), BLOCK_MAGIC (uint32)
+   Appending after reopening adds frames after whatever follows the old trailer and a new index covering all frames on close. */
+bool BinaryStream::BlockOpen(enum_mode method, unsigned long int container_end){
+
+  m_frames.clear();
+  m_block.clear();
+  m_block_frame=-1;
+  m_block_open_id=++block_open_ids;
+  m_write_block.clear();
+  m_block_modified=false;
+  m_pos=0;
+  
+  struct stat fbuffer;
+  bool exists= (stat(m_file_name.c_str(), &fbuffer) == 0 && fbuffer.st_size>0);
+  if(method==READ) pfile = fopen(m_file_name.c_str(), "rb");
+  else if(method==NEW || method==NEW_READ || !exists){
+    pfile = fopen(m_file_name.c_str(), "wb+");
+    exists=false;
+  }
+  else pfile = fopen(m_file_name.c_str(), "rb+");
+  if(pfile==NULL) return false;
+  if(!exists) return true;
+  
+  if(container_end==0) container_end=static_cast<unsigned long int>(fbuffer.st_size);
+  uint64_t index_start=0;
+  uint32_t magic=0;
+  uint64_t frames=0;
+  bool ok= container_end>=sizeof(index_start)+sizeof(magic);
+  ok= ok && !fseek(pfile, static_cast<long int>(container_end-sizeof(index_start)-sizeof(magic)), SEEK_SET);
+  ok= ok && fread(&index_start, sizeof(index_start), 1, pfile) && fread(&magic, sizeof(magic), 1, pfile) && magic==BLOCK_MAGIC;
+  ok= ok && !fseek(pfile, static_cast<long int>(index_start), SEEK_SET) && fread(&frames, sizeof(frames), 1, pfile);
+  if(ok) m_frames.resize(frames);
+  uint64_t logical=0;
+  for(uint64_t i=0; ok && i<frames; i++){
+    BlockFrame& frame=m_frames[i];
+    ok= fread(&frame.file_offset, sizeof(frame.file_offset), 1, pfile) && fread(&frame.compressed_size, sizeof(frame.compressed_size), 1, pfile) && fread(&frame.uncompressed_size, sizeof(frame.uncompressed_size), 1, pfile);
+    frame.logical_offset=logical;
+    logical+=frame.uncompressed_size;
+  }
+  if(!ok){
+    fclose(pfile);
+    pfile=0;
+    m_frames.clear();
+    return false;
+  }
+  
+  return true;
+}
+
+bool BinaryStream::BlockClose(bool write_index){
+
+  if(pfile==0) return false;
+  bool ret=true;
+  
+  if(write_index){
+    if(m_write_block.length()) ret= BlockWriteFrames(m_write_block.data(), m_write_block.length());
+    if(ret && m_block_modified){
+      ret= !fseek(pfile, 0, SEEK_END);
+      long int index_start=ftell(pfile);
+      ret= ret && index_start>=0;
+      std::string index;
+      uint64_t frames=m_frames.size();
+      index.append(reinterpret_cast<const char*>(&frames), sizeof(frames));
+      for(size_t i=0; i<m_frames.size(); i++){
+	index.append(reinterpret_cast<const char*>(&m_frames[i].file_offset), sizeof(m_frames[i].file_offset));
+	index.append(reinterpret_cast<const char*>(&m_frames[i].compressed_size), sizeof(m_frames[i].compressed_size));
+	index.append(reinterpret_cast<const char*>(&m_frames[i].uncompressed_size), sizeof(m_frames[i].uncompressed_size));
+      }
+      uint64_t start=static_cast<uint64_t>(index_start);
+      uint32_t magic=BLOCK_MAGIC;
+      index.append(reinterpret_cast<const char*>(&start), sizeof(start));
+      index.append(reinterpret_cast<const char*>(&magic), sizeof(magic));
+      ret= ret && fwrite(index.data(), index.length(), 1, pfile);
+    }
+  }
+  
+  if(fclose(pfile)) ret=false;
+  pfile=0;
+  m_frames.clear();
+  m_block.clear();
+  m_block_frame=-1;
+  m_write_block.clear();
+  m_block_modified=false;
+  m_pos=0;
+  
+  return ret;
+}
+
+void BinaryStream::SetCompressionThreads(unsigned int threads){
+
+  m_compression_threads= threads ? threads : 1;
+  CompressionWorkers();
+
+}
+
+CompressionPool* BinaryStream::CompressionWorkers(){
+
+  if(m_compression_threads<=1) m_compression_pool.reset();
+  else if(!m_compression_pool || m_compression_pool->Threads()!=m_compression_threads) m_compression_pool.reset(new CompressionPool(m_compression_threads));
+  
+  return m_compression_pool.get();
+}
+
+bool BinaryStream::BlockWriteFrames(const char* in, unsigned long int size){
+
+  std::vector<std::string> compressed;
+  if(m_codec!=NO_CODEC && !Codec::CompressBlocks(m_codec, m_codec_level, in, size, m_block_size, compressed, CompressionWorkers())){
+    std::clog<<"ERROR BinaryStream::BlockWriteFrames : Error compressing frames with codec "<<(int)m_codec<<std::endl;
+    return false;
+  }
+  
+  for(unsigned long int start=0, i=0; start<size; start+=m_block_size, i++){
+    if(!BlockWriteFrame(in+start, (size-start<m_block_size ? size-start : m_block_size), (i<compressed.size() ? compressed[i] : std::string()))) return false;
+  }
+  
+  return true;
+}
+
+bool BinaryStream::BlockWriteFrame(const char* in, unsigned long int size, const std::string& compressed){
+
+  BlockFrame frame;
+  frame.logical_offset= m_frames.size() ? m_frames.back().logical_offset+m_frames.back().uncompressed_size : 0;
+  frame.uncompressed_size=size;
+  frame.compressed_size=size;
+  uint8_t codec=NO_CODEC;
+  const char* data=in;
+  
+  if(m_codec!=NO_CODEC && compressed.length() && compressed.length()<size){ // store uncompressible frames as is
+    codec=m_codec;
+    data=compressed.data();
+    frame.compressed_size=compressed.length();
+  }
+  
+  if(fseek(pfile, 0, SEEK_END)) return false;
+  long int pos=ftell(pfile);
+  if(pos<0) return false;
+  frame.file_offset=static_cast<uint64_t>(pos);
+  
+  if(!fwrite(&codec, sizeof(codec), 1, pfile)) return false;
+  if(!fwrite(&frame.compressed_size, sizeof(frame.compressed_size), 1, pfile)) return false;
+  if(!fwrite(&frame.uncompressed_size, sizeof(frame.uncompressed_size), 1, pfile)) return false;
+  if(frame.compressed_size && !fwrite(data, frame.compressed_size, 1, pfile)) return false;
+  
+  m_frames.push_back(frame);
+  m_block_modified=true;
+  
+  return true;
+}
+
+bool BinaryStream::BlockLoadFrame(size_t frame){
+
+  if(m_block_frame>=0 && static_cast<size_t>(m_block_frame)==frame) return true;
+  m_block_frame=-1;
+  if(frame>=m_frames.size()) return false;
+  
+  uint8_t codec=0;
+  uint32_t compressed_size=0;
+  uint32_t uncompressed_size=0;
+  if(fseek(pfile, static_cast<long int>(m_frames[frame].file_offset), SEEK_SET)) return false;
+  if(!fread(&codec, sizeof(codec), 1, pfile)) return false;
+  if(!fread(&compressed_size, sizeof(compressed_size), 1, pfile)) return false;
+  if(!fread(&uncompressed_size, sizeof(uncompressed_size), 1, pfile)) return false;
+  if(compressed_size!=m_frames[frame].compressed_size || uncompressed_size!=m_frames[frame].uncompressed_size) return false;
+  
+  m_block.resize(uncompressed_size);
+  if(codec==NO_CODEC){
+    if(uncompressed_size && !fread(&m_block[0], uncompressed_size, 1, pfile)) return false;
+  }
+  else{
+    Codec* decompressor=Codec::Get(static_cast<enum_codec>(codec));
+    if(decompressor==0){
+      std::clog<<"ERROR BinaryStream::BlockLoadFrame : unsupported frame codec "<<(int)codec<<std::endl;
+      return false;
+    }
+    m_compressed.resize(compressed_size);
+    if(compressed_size && !fread(&m_compressed[0], compressed_size, 1, pfile)) return false;
+    if(!decompressor->Decompress(m_compressed.data(), compressed_size, &m_block[0], uncompressed_size)){
+      std::clog<<"ERROR BinaryStream::BlockLoadFrame : corrupt "<<decompressor->Name()<<" frame "<<frame<<std::endl;
+      return false;
+    }
+  }
+  
+  m_block_frame=static_cast<long int>(frame);
+  return true;
+}
+
+unsigned long int BinaryStream::BlockLength(){
+
+  unsigned long int framed= m_frames.size() ? m_frames.back().logical_offset+m_frames.back().uncompressed_size : 0;
+  return framed+m_write_block.length();
+
+}
+
 /* Compress from file source to file dest until EOF on source.
    def() returns Z_OK on success, Z_MEM_ERROR if memory could not be
    allocated for processing, Z_STREAM_ERROR if an invalid compression
@@ -363,6 +786,31 @@ int BinaryStream::def(FILE *source, FILE *dest, int level){
   return 0;
 }
 
+/* Compress from file source to file dest until EOF on source using several
+   threads. The input is split into chunks that are deflated independantly and
+   written in order as concatenated zlib streams, which inf() reads back. Memory
+   use is bounded to a few chunks per thread. */
+int BinaryStream::pdef(FILE *source, FILE *dest, int level, CompressionPool* pool){
+#ifdef ZLIB
+  const unsigned long int chunk=1048576;
+  const unsigned int threads= pool ? pool->Threads() : 1;
+  std::string in;
+  std::vector<std::string> out;
+  
+  for (bool first = true; ; first = false) {
+    in.resize(chunk*threads);
+    in.resize(fread(&in[0], 1, in.length(), source));
+    if (ferror(source)) return Z_ERRNO;
+    if (in.empty()) return first ? def(source, dest, level) : Z_OK; /* an empty source still gets one empty stream */
+    if (!Codec::CompressBlocks(ZLIB_CODEC, level, in.data(), in.length(), chunk, out, pool)) return Z_STREAM_ERROR;
+    for (size_t i = 0; i < out.size(); i++) {
+      if (fwrite(out[i].data(), 1, out[i].length(), dest) != out[i].length() || ferror(dest)) return Z_ERRNO;
+    }
+  }
+#endif
+  return 0;
+}
+
 int BinaryStream::inf(FILE *source, FILE *dest){
 
 #ifdef ZLIB
@@ -412,7 +860,16 @@ int BinaryStream::inf(FILE *source, FILE *dest){
 	(void)inflateEnd(&strm);
 	return Z_ERRNO;
       }
-    } while (strm.avail_out == 0);
+      /* files written by pdef() are concatenated streams, carry on if more data follows */
+      if (ret == Z_STREAM_END) {
+	int next = strm.avail_in ? 0 : fgetc(source);
+	if (strm.avail_in || next != EOF) {
+	  if (!strm.avail_in) ungetc(next, source);
+	  (void)inflateReset(&strm);
+	  ret = Z_OK;
+	}
+      }
+    } while (strm.avail_out == 0 || (ret == Z_OK && strm.avail_in > 0));
     
     /* done when inflate() says it's done */
   } while (ret != Z_STREAM_END);
@@ -458,6 +915,40 @@ size_t BinaryStream::Size(){
   
 }
 
+bool BinaryStream::Reserve(size_t size){
+
+  if(m_endpoint!=RAM) return false;
+  buffer.reserve(size);
+  return true;
+
+}
+
+void BinaryStream::Reset(){
+
+  buffer.clear(); // keeps capacity
+  m_pos=0;
+
+}
+
+bool BinaryStream::WriteSize(uint64_t size){
+
+  uint32_t tmp= size<LONG_SIZE ? size : LONG_SIZE;
+  if(!Bwrite(&tmp, sizeof(tmp))) return false;
+  if(tmp==LONG_SIZE) return Bwrite(&size, sizeof(size));
+  return true;
+
+}
+
+bool BinaryStream::ReadSize(uint64_t& size){
+
+  uint32_t tmp=0;
+  if(!Bread(&tmp, sizeof(tmp))) return false;
+  size=tmp;
+  if(tmp==LONG_SIZE) return Bread(&size, sizeof(size));
+  return true;
+
+}
+
 
 bool SerialisableObject::SerialiseWrapper(BinaryStream &bs){
   //  if(!m_serialise) return false; //not sure i should ahve a serialise flag, causes major issues with empty mapps and vector elements!!!! so remove. People wouldnt be calling serialise method if they didnt want to serialse
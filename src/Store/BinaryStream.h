@@ -9,8 +9,14 @@
 #include <map>
 #include <deque>
 #include <SerialisableObject.h>
+#include <Codec.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <sys/mman.h> //for mmap
+#include <fcntl.h>
+#include <memory>
+#include <type_traits>
+#include <stdint.h>
 #ifdef ZLIB
 #include <zlib.h>
 #endif
@@ -21,31 +27,118 @@ namespace ToolFramework{
   
 #define CHUNK 16384 // dito
   
-  enum enum_endpoint { RAM , UNCOMPRESSED , POST_PRE_COMPRESS, COMPRESSED };
+  enum enum_endpoint { RAM , UNCOMPRESSED , POST_PRE_COMPRESS, COMPRESSED, MMAP, BLOCK_COMPRESSED }; // MMAP is read only access to an uncompressed file through a memory mapping (or, when the owner sets up m_map itself and the mode is not READ, read write access to that memory), BLOCK_COMPRESSED is a seekable container of independently compressed frames
   enum enum_mode { READ , NEW , APPEND, UPDATE, READ_APPEND, NEW_READ };
   
+#define BLOCK_MAGIC 0x31465342 // "BSF1" marks the end of a BLOCK_COMPRESSED frame index
+#define LONG_SIZE 0xFFFFFFFF // a 32 bit length of this value is followed by the real 64 bit length
+  
+  /**
+   * \struct BlockFrame
+   *
+   * Index entry for one independently compressed frame of a BLOCK_COMPRESSED stream.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  struct BlockFrame{
+    
+    uint64_t file_offset; ///< position of the frame header in the file
+    uint64_t logical_offset; ///< position of the frames first uncompressed byte in the stream
+    uint32_t compressed_size; ///< size of the frame data on disk
+    uint32_t uncompressed_size; ///< size of the frame data once decompressed
+    
+  };
+  
+  /**
+   * \class BinaryView
+   *
+   * A non owning view of a serialised string or vector of trivially copyable values. When read from a RAM or MMAP BinaryStream the view points straight into the stream's buffer or mapping, so it is only valid until the stream is next modified, reloaded or closed. If the stream cannot lend its memory or the data is not aligned for T a private copy is held instead.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+  
+  template<typename T> class BinaryView{
+    
+    static_assert(std::is_trivially_copyable<T>::value, "BinaryView requires a trivially copyable type");
+    
+  public:
+    
+    BinaryView(): m_data(0), m_size(0), m_borrowed(false){} ///< Simple constructor
+    BinaryView(const BinaryView& in): m_data(in.m_data), m_size(in.m_size), m_borrowed(in.m_borrowed), m_copy(in.m_copy){ if(!m_borrowed) m_data=m_copy.data(); } ///< Copy constructor, a private copy is rebased onto the new object
+    BinaryView& operator=(const BinaryView& in){ m_size=in.m_size; m_borrowed=in.m_borrowed; m_copy=in.m_copy; m_data= m_borrowed ? in.m_data : m_copy.data(); return *this; } ///< Assignment operator
+    
+    const T* data() const { return m_data; } ///< pointer to the first element
+    size_t size() const { return m_size; } ///< number of elements
+    bool empty() const { return m_size==0; } ///< if the view has no elements
+    const T* begin() const { return m_data; } ///< iterator to the first element
+    const T* end() const { return m_data+m_size; } ///< iterator past the last element
+    const T& operator[](size_t i) const { return m_data[i]; } ///< element access
+    bool Borrowed() const { return m_borrowed; } ///< true if the view points into the stream rather than holding a copy
+    std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); } ///< returns an owning copy of the elements
+    
+    void Borrow(const T* in, size_t size){ ///< point the view at external memory @param in first element @param size number of elements
+      m_copy.clear();
+      m_data=in;
+      m_size=size;
+      m_borrowed=true;
+    }
+    
+    T* Copy(size_t size){ ///< switch the view to a private copy of the given number of elements @return pointer to fill the copy through
+      m_copy.resize(size);
+      m_data=m_copy.data();
+      m_size=size;
+      m_borrowed=false;
+      return m_copy.data();
+    }
+    
+  private:
+    
+    const T* m_data;
+    size_t m_size;
+    bool m_borrowed;
+    std::vector<T> m_copy;
+    
+  };
+  
+
   class BinaryStream : public SerialisableObject{ 
     
   public:
     
     BinaryStream(enum_endpoint endpoint=RAM);
     ~BinaryStream();
-    bool Bopen(std::string filename, enum_mode method=UPDATE, enum_endpoint endpoint=POST_PRE_COMPRESS);
+    bool Bopen(std::string filename, enum_mode method=UPDATE, enum_endpoint endpoint=POST_PRE_COMPRESS, unsigned long int container_end=0); ///< container_end is the file position where a BLOCK_COMPRESSED container finishes if other data follows it, 0 for the end of the file
     bool Bclose(bool Ignore_Post_Pre_compress=false);
-    bool Bwrite(const void* in, unsigned int size);
-    bool Bread(void* out, unsigned int size);
+    bool Bwrite(const void* in, unsigned long int size);
+    bool Bread(void* out, unsigned long int size);
+    bool Bview(const char* &out, unsigned long int size); ///< Point out at the next size bytes of a RAM buffer or MMAP mapping and advance past them without copying. Returns false for other endpoints.
+    unsigned long int Bpread(void* out, unsigned long int size, unsigned long int pos) const; ///< Read up to size bytes starting at pos without using or moving the stream position, so several threads can read at once from a stream nothing is writing to. Not available for COMPRESSED. For BLOCK_COMPRESSED each calling thread keeps the last frame it decompressed for its next read. @return number of bytes read, less than size at the end of the data
     unsigned long int Btell();
-    bool Bseek(unsigned int pos, int whence);
+    bool Bseek(unsigned long int pos, int whence);
     bool Print();
     bool Serialise(BinaryStream &bs);  
     std::string GetVersion();
     size_t Size();
+    bool Reserve(size_t size); ///< Preallocate RAM buffer capacity @param size number of bytes to reserve @return false if the endpoint is not RAM
+    void Reset(); ///< Empty the RAM buffer and rewind, keeping the allocated capacity for reuse
+    bool WriteSize(uint64_t size); ///< Write a string or container length. Lengths below LONG_SIZE are 32 bit as in older streams, larger ones are LONG_SIZE followed by the 64 bit length
+    bool ReadSize(uint64_t& size); ///< Read a length written by WriteSize
       
     enum_endpoint m_endpoint;
     FILE* pfile;
 #ifdef ZLIB
     gzFile* gzfile;
 #endif
+    std::shared_ptr<char> m_map; ///< read only mapping of the file for the MMAP endpoint, or memory lent by the owner of the stream (shared so copies of the stream dont unmap it twice)
+    unsigned long int m_map_size; ///< size of the mapped file or lent memory, writes past it fail
+    unsigned long int m_block_size; ///< uncompressed size of the frames written by the BLOCK_COMPRESSED endpoint
+    enum_codec m_codec; ///< codec used to compress BLOCK_COMPRESSED frames (each frame records its own codec so reading picks the right one)
+    int m_codec_level; ///< compression level for the codec, also used for zlib in POST_PRE_COMPRESS and COMPRESSED. -1 for the defaults
+    unsigned int m_compression_threads; ///< threads used to compress BLOCK_COMPRESSED frames and the POST_PRE_COMPRESS file on close. Above 1 the POST_PRE_COMPRESS file is written as a series of concatenated zlib streams. Prefer SetCompressionThreads, which starts the threads straight away
+    void SetCompressionThreads(unsigned int threads); ///< sets m_compression_threads and starts the worker threads, which are kept and reused for every batch of frames until the number changes @param threads number of threads, 1 to compress on the calling thread
     std::string buffer;
     bool m_write;
     std::string m_file_name;
@@ -63,8 +156,8 @@ namespace ToolFramework{
     bool operator<<(std::string& rhs){
       if(m_mode!=READ){
 	bool ret=true;    
-	unsigned int tmp=rhs.length();
-	ret= ret && ((*this) << tmp);
+	uint64_t tmp=rhs.length();
+	ret= ret && WriteSize(tmp);
 	if(tmp) ret= ret && (Bwrite(&(rhs[0]), tmp));
 	return ret;
       }
@@ -74,8 +167,8 @@ namespace ToolFramework{
     bool operator>>(std::string& rhs){
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;
-	ret= ret && ((*this) >> tmp);
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
 	rhs.resize(tmp);
 	if(tmp) ret= ret && (Bread(&(rhs[0]), tmp));
 	return ret;
@@ -91,8 +184,8 @@ namespace ToolFramework{
     bool operator<<(const std::string& rhs){
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.length();
-	ret= ret && ((*this) << tmp);
+	uint64_t tmp=rhs.length();
+	ret= ret && WriteSize(tmp);
 	if(tmp) ret= ret && (Bwrite(&(rhs[0]), tmp));
 	return ret;
       }
@@ -158,8 +251,8 @@ namespace ToolFramework{
       
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.size();
-	ret= ret && ((*this) << tmp);
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
 	if(tmp){
 	  if(check_base<SerialisableObject,T>::value){
 	    for(typename std::vector<T>::iterator it=rhs.begin(); it!=rhs.end(); it++) ret= ret && ((*this) << (*it));
@@ -175,8 +268,8 @@ namespace ToolFramework{
       
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;
-	ret= ret && ((*this) >> tmp);
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
 	rhs.resize(tmp);
 	if(tmp){
 	  if(check_base<SerialisableObject,T>::value){
@@ -195,12 +288,47 @@ namespace ToolFramework{
       else return (*this) >> rhs;
     }
     
+    template<typename T> bool operator<<(BinaryView<T>& rhs){
+      if(m_mode!=READ){
+	bool ret=true;
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
+	if(tmp) ret= ret && (Bwrite(rhs.data(), tmp*sizeof(T)));
+	return ret;
+      }
+      else return false;
+    }
+    
+    template<typename T> bool operator>>(BinaryView<T>& rhs){
+      if(m_mode!=NEW && m_mode!=APPEND){
+	uint64_t tmp=0;
+	if(!ReadSize(tmp)) return false;
+	if(!tmp){
+	  rhs.Borrow(0, 0);
+	  return true;
+	}
+	const char* data=0;
+	if(Bview(data, tmp*sizeof(T))){
+	  if(reinterpret_cast<uintptr_t>(data) % alignof(T) == 0) rhs.Borrow(reinterpret_cast<const T*>(data), tmp);
+	  else memcpy(rhs.Copy(tmp), data, tmp*sizeof(T));
+	  return true;
+	}
+	return Bread(rhs.Copy(tmp), tmp*sizeof(T));
+      }
+      else return false;
+    }
+    
+    template<typename T> bool operator&(BinaryView<T>& rhs){
+      if(m_write) return (*this) << rhs;
+      else return (*this) >> rhs;
+    }
+    
     bool operator<<(std::vector<std::string>& rhs){
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.size();
-	ret= ret && ((*this) << tmp);
-	for(unsigned int i=0; i<tmp; i++){
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
+	for(uint64_t i=0; i<tmp; i++){
 	  ret= ret && ((*this) << rhs.at(i));
 	}
 	return ret;
@@ -211,10 +339,10 @@ namespace ToolFramework{
     bool operator>>(std::vector<std::string>& rhs){
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;
-	ret= ret && ((*this) >> tmp);
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
 	rhs.resize(tmp);
-	for(unsigned int i=0; i<tmp; i++){
+	for(uint64_t i=0; i<tmp; i++){
 	  ret= ret && ((*this) >> rhs.at(i));
 	}
 	return ret;
@@ -230,8 +358,8 @@ namespace ToolFramework{
     template<typename T, typename U> bool operator<<(std::map<T,U>& rhs){
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.size();
-	ret= ret && ((*this) << tmp);
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
 	for (typename std::map<T,U>::iterator it=rhs.begin(); it!=rhs.end(); ++it){
 	  T key=it->first;
 	  U value=it->second;
@@ -246,9 +374,9 @@ namespace ToolFramework{
     template<typename T, typename U> bool operator>>(std::map<T,U>& rhs){
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;      
-	ret= ret && ((*this) >> tmp);
-	for (unsigned int i=0; i<tmp; i++){
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
+	for (uint64_t i=0; i<tmp; i++){
 	  T key;
 	  U value;
 	  ret= ret && ((*this) >> key);
@@ -268,8 +396,8 @@ namespace ToolFramework{
     template<typename T> bool operator<<(std::deque<T>& rhs){
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.size(); 
-	ret= ret && ((*this) << tmp);
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
 	if(tmp){
 	  if(check_base<SerialisableObject,T>::value){
 	    for(typename std::deque<T>::iterator it=rhs.begin(); it!=rhs.end(); it++) ret= ret && ((*this) << (*it));	
@@ -284,8 +412,8 @@ namespace ToolFramework{
     template<typename T> bool operator>>(std::deque<T>& rhs){
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;
-	ret= ret && ((*this) >> tmp);
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
 	rhs.resize(tmp);
 	if(tmp){
 	  if(check_base<SerialisableObject,T>::value){
@@ -306,9 +434,9 @@ namespace ToolFramework{
     bool operator<<(std::deque<std::string>& rhs){
       if(m_mode!=READ){
 	bool ret=true;
-	unsigned int tmp=rhs.size();
-	ret= ret && ((*this) << tmp);
-	for(unsigned int i=0; i<tmp; i++){
+	uint64_t tmp=rhs.size();
+	ret= ret && WriteSize(tmp);
+	for(uint64_t i=0; i<tmp; i++){
 	  ret= ret && ((*this) << rhs.at(i));
 	}
 	return ret;
@@ -319,10 +447,10 @@ namespace ToolFramework{
     bool operator>>(std::deque<std::string>& rhs){
       if(m_mode!=NEW && m_mode!=APPEND){
 	bool ret=true;
-	unsigned int tmp=0;
-	ret= ret && ((*this) >> tmp);
+	uint64_t tmp=0;
+	ret= ret && ReadSize(tmp);
 	rhs.resize(tmp);
-	for(unsigned int i=0; i<tmp; i++){
+	for(uint64_t i=0; i<tmp; i++){
 	  ret= ret && ((*this) >> rhs.at(i));
 	}
 	return ret;
@@ -338,7 +466,25 @@ namespace ToolFramework{
     
   private:
     
+    bool BlockOpen(enum_mode method, unsigned long int container_end);
+    bool BlockClose(bool write_index);
+    bool BlockWriteFrames(const char* in, unsigned long int size);
+    bool BlockWriteFrame(const char* in, unsigned long int size, const std::string& compressed);
+    bool BlockLoadFrame(size_t frame);
+    unsigned long int BlockLength();
+    
+    std::vector<BlockFrame> m_frames; ///< frame index of a BLOCK_COMPRESSED stream
+    std::string m_block; ///< decompressed contents of the currently loaded frame
+    long int m_block_frame; ///< index of the loaded frame, -1 if none
+    uint64_t m_block_open_id; ///< different for every opening of a BLOCK_COMPRESSED file, identifies the frames cached by Bpread
+    std::string m_write_block; ///< data appended but not yet written as a frame
+    std::string m_compressed; ///< scratch space for compressed frames
+    bool m_block_modified; ///< if frames have been added since opening so a new index is needed
+    std::shared_ptr<CompressionPool> m_compression_pool; ///< workers for m_compression_threads, kept between frame batches
+    
+    CompressionPool* CompressionWorkers(); ///< the worker pool for m_compression_threads, restarted if the number has been changed, 0 for a single thread
     int def(FILE *source, FILE *dest, int level);
+    int pdef(FILE *source, FILE *dest, int level, CompressionPool* pool);
     int inf(FILE *source, FILE *dest);
     void zerr(int ret);
     
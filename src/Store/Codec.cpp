@@ -0,0 +1,281 @@
+#include <Codec.h>
+#include <atomic>
+
+using namespace ToolFramework;
+
+Codec* Codec::Get(enum_codec codec){
+
+  static NoCodec no_codec;
+  static FastCodec fast_codec;
+#ifdef ZLIB
+  static ZlibCodec zlib_codec;
+#endif
+
+  if(codec==NO_CODEC) return &no_codec;
+  else if(codec==FAST_CODEC) return &fast_codec;
+#ifdef ZLIB
+  else if(codec==ZLIB_CODEC) return &zlib_codec;
+#endif
+  return 0;
+
+}
+
+enum_codec Codec::Default(){
+
+#ifdef ZLIB
+  return ZLIB_CODEC;
+#endif
+  return FAST_CODEC;
+
+}
+
+bool Codec::CompressBlocks(enum_codec codec, int level, const char* in, unsigned long int size, unsigned long int block_size, std::vector<std::string>& out, CompressionPool* pool){
+
+  Codec* compressor=Get(codec);
+  if(compressor==0 || block_size==0) return false;
+  
+  size_t blocks=(size+block_size-1)/block_size;
+  out.resize(blocks);
+  
+  std::atomic<size_t> next(0);
+  std::atomic<bool> ok(true);
+  std::function<void()> worker=[&](){
+    for(size_t i=next++; i<blocks; i=next++){
+      unsigned long int start=i*block_size;
+      if(!compressor->Compress(in+start, (size-start<block_size ? size-start : block_size), out[i], level)) ok=false;
+    }
+  };
+  
+  if(pool!=0 && blocks>1) pool->Run(worker);
+  else worker();
+  
+  return ok;
+}
+
+//////////////////////// CompressionPool
+
+CompressionPool::CompressionPool(unsigned int threads){
+
+  m_task=0;
+  m_batch=0;
+  m_busy=0;
+  m_stop=false;
+  for(unsigned int i=1; i<threads; i++) m_workers.push_back(std::thread(&CompressionPool::Worker, this));
+
+}
+
+CompressionPool::~CompressionPool(){
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stop=true;
+  }
+  m_start.notify_all();
+  for(size_t i=0; i<m_workers.size(); i++) m_workers[i].join();
+
+}
+
+void CompressionPool::Run(const std::function<void()>& task){
+
+  std::lock_guard<std::mutex> call(m_call_lock);
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_task=&task;
+    m_busy=m_workers.size();
+    m_batch++;
+  }
+  m_start.notify_all();
+  task();
+  
+  std::unique_lock<std::mutex> lock(m_lock);
+  while(m_busy) m_finished.wait(lock);
+  m_task=0;
+
+}
+
+void CompressionPool::Worker(){
+
+  unsigned long int seen=0;
+  std::unique_lock<std::mutex> lock(m_lock);
+  while(true){
+    while(!m_stop && m_batch==seen) m_start.wait(lock);
+    if(m_stop) return;
+    seen=m_batch;
+    const std::function<void()>* task=m_task;
+    lock.unlock();
+    (*task)();
+    lock.lock();
+    if(--m_busy==0) m_finished.notify_one();
+  }
+
+}
+
+//////////////////////// NoCodec
+
+bool NoCodec::Compress(const char* in, unsigned long int size, std::string& out, int level){
+
+  out.assign(in, size);
+  return true;
+
+}
+
+bool NoCodec::Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size){
+
+  if(size!=out_size) return false;
+  memcpy(out, in, size);
+  return true;
+
+}
+
+//////////////////////// ZlibCodec
+
+#ifdef ZLIB
+bool ZlibCodec::Compress(const char* in, unsigned long int size, std::string& out, int level){
+
+  if(level<0 || level>9) level=Z_DEFAULT_COMPRESSION;
+  uLongf compressed_size=compressBound(size);
+  out.resize(compressed_size);
+  if(compress2(reinterpret_cast<Bytef*>(&out[0]), &compressed_size, reinterpret_cast<const Bytef*>(in), size, level)!=Z_OK) return false;
+  out.resize(compressed_size);
+  return true;
+
+}
+
+bool ZlibCodec::Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size){
+
+  uLongf uncompressed_size=out_size;
+  if(uncompress(reinterpret_cast<Bytef*>(out), &uncompressed_size, reinterpret_cast<const Bytef*>(in), size)!=Z_OK) return false;
+  return uncompressed_size==out_size;
+
+}
+#endif
+
+//////////////////////// FastCodec
+
+/* Each sequence is a token byte (high nibble literal count, low nibble match length-4, 15 meaning more length bytes follow),
+   the literals, a little endian 16 bit match offset and any extra match length bytes. The final sequence has literals only. */
+
+#define FAST_HASH_BITS 14
+#define FAST_MIN_MATCH 4
+#define FAST_MAX_OFFSET 65535
+
+static inline uint32_t read32(const char* p){
+  uint32_t ret;
+  memcpy(&ret, p, sizeof(ret));
+  return ret;
+}
+
+void FastCodec::WriteLength(std::string& out, unsigned long int length){
+
+  length-=15;
+  while(length>=255){
+    out.push_back(static_cast<char>(255));
+    length-=255;
+  }
+  out.push_back(static_cast<char>(length));
+
+}
+
+bool FastCodec::Compress(const char* in, unsigned long int size, std::string& out, int level){
+
+  out.clear();
+  out.reserve(size + size/255 + 16);
+
+  uint32_t table[1<<FAST_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  unsigned long int ip=0;
+  unsigned long int anchor=0;
+  unsigned long int limit= size>12 ? size-12 : 0; // leave trailing bytes as literals
+  unsigned long int misses=0;
+
+  while(ip<limit){
+
+    uint32_t sequence=read32(in+ip);
+    uint32_t hash=(sequence*2654435761U)>>(32-FAST_HASH_BITS);
+    unsigned long int candidate=table[hash];
+    table[hash]=static_cast<uint32_t>(ip);
+
+    if(candidate>=ip || ip-candidate>FAST_MAX_OFFSET || read32(in+candidate)!=sequence){
+      ip+= 1 + (misses++>>6); // skip faster through uncompressible data
+      continue;
+    }
+    misses=0;
+
+    unsigned long int match=FAST_MIN_MATCH;
+    while(ip+match<size-5 && in[candidate+match]==in[ip+match]) match++;
+
+    unsigned long int literals=ip-anchor;
+    unsigned long int extra=match-FAST_MIN_MATCH;
+    out.push_back(static_cast<char>(((literals<15 ? literals : 15)<<4) | (extra<15 ? extra : 15)));
+    if(literals>=15) WriteLength(out, literals);
+    out.append(in+anchor, literals);
+    unsigned long int offset=ip-candidate;
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset>>8));
+    if(extra>=15) WriteLength(out, extra);
+
+    ip+=match;
+    anchor=ip;
+  }
+
+  unsigned long int literals=size-anchor;
+  out.push_back(static_cast<char>((literals<15 ? literals : 15)<<4));
+  if(literals>=15) WriteLength(out, literals);
+  out.append(in+anchor, literals);
+
+  return true;
+
+}
+
+bool FastCodec::Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size){
+
+  const unsigned char* src=reinterpret_cast<const unsigned char*>(in);
+  unsigned long int ip=0;
+  unsigned long int op=0;
+
+  while(ip<size){
+
+    unsigned int token=src[ip++];
+
+    unsigned long int literals=token>>4;
+    if(literals==15){
+      unsigned char byte=255;
+      while(byte==255){
+	if(ip>=size) return false;
+	byte=src[ip++];
+	literals+=byte;
+      }
+    }
+    if(literals>size-ip || literals>out_size-op) return false;
+    memcpy(out+op, src+ip, literals);
+    ip+=literals;
+    op+=literals;
+
+    if(ip==size) break; // last sequence has no match
+
+    if(size-ip<2) return false;
+    unsigned long int offset=src[ip] | (src[ip+1]<<8);
+    ip+=2;
+    if(offset==0 || offset>op) return false;
+
+    unsigned long int match=token & 15;
+    if(match==15){
+      unsigned char byte=255;
+      while(byte==255){
+	if(ip>=size) return false;
+	byte=src[ip++];
+	match+=byte;
+      }
+    }
+    match+=FAST_MIN_MATCH;
+    if(match>out_size-op) return false;
+
+    if(offset>=match) memcpy(out+op, out+op-offset, match);
+    else for(unsigned long int i=0; i<match; i++) out[op+i]=out[op+i-offset]; // overlapping copy repeats the pattern
+    op+=match;
+  }
+
+  return op==out_size;
+
+}
@@ -0,0 +1,145 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+
+namespace ToolFramework{
+
+  enum enum_codec { NO_CODEC, ZLIB_CODEC, FAST_CODEC }; // values are written to files so only append new codecs
+
+  /**
+   * \class CompressionPool
+   *
+   * Persistent set of worker threads used by Codec::CompressBlocks, so a stream compressing many batches of blocks starts its threads once rather than for every batch. The calling thread works alongside the pool, so a pool of n threads keeps n-1 workers. One batch runs at a time, callers sharing a pool queue on it.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  class CompressionPool{
+
+  public:
+
+    CompressionPool(unsigned int threads); ///< starts the workers @param threads total threads including the caller's
+    ~CompressionPool(); ///< stops and joins the workers
+    unsigned int Threads() const { return m_workers.size()+1; } ///< total threads including the caller's
+    void Run(const std::function<void()>& task); ///< runs task on every worker and the calling thread at once and returns when all have finished @param task function that takes work from a shared source until there is none left
+
+  private:
+
+    CompressionPool(const CompressionPool&);
+    CompressionPool& operator=(const CompressionPool&);
+    void Worker();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_call_lock; ///< held for the length of Run so batches dont overlap
+    std::mutex m_lock;
+    std::condition_variable m_start;
+    std::condition_variable m_finished;
+    const std::function<void()>* m_task;
+    unsigned long int m_batch; ///< incremented for each Run so workers can tell a new batch from a spurious wake
+    unsigned int m_busy; ///< workers yet to finish the current batch
+    bool m_stop;
+
+  };
+
+  /**
+   * \class Codec
+   *
+   * Abstract base class for the block compression codecs used by BinaryStream and BStore. Codecs compress and decompress whole independant blocks. Use Codec::Get to obtain the shared instance of a codec.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  class Codec{
+
+  public:
+
+    virtual ~Codec(){} ///< virtual destructor
+    virtual bool Compress(const char* in, unsigned long int size, std::string& out, int level=-1)=0; ///< compress a block @param in data to compress @param size number of bytes @param out string to place compressed data in (replaces contents) @param level codec specific compression level, -1 for the codec default @return false on error
+    virtual bool Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size)=0; ///< decompress a block @param in compressed data @param size compressed size @param out buffer to fill @param out_size exact uncompressed size expected @return false if the data is corrupt or the size doesnt match
+    virtual std::string Name()=0; ///< name of the codec for messages
+
+    static Codec* Get(enum_codec codec); ///< returns the shared instance for a codec or 0 if it is not available in this build @param codec the codec to get
+    static enum_codec Default(); ///< default codec for compressed output, zlib if built with it otherwise the fast codec
+    static bool CompressBlocks(enum_codec codec, int level, const char* in, unsigned long int size, unsigned long int block_size, std::vector<std::string>& out, CompressionPool* pool=0); ///< compress consecutive blocks of the input independantly, spread over several threads @param block_size size of each block, the last may be shorter @param out filled with one compressed string per block, in order @param pool threads to use, 0 to compress on the calling thread only @return false if any block fails
+
+  };
+
+  /**
+   * \class NoCodec
+   *
+   * Codec that stores blocks unchanged.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  class NoCodec : public Codec{
+
+  public:
+
+    bool Compress(const char* in, unsigned long int size, std::string& out, int level=-1);
+    bool Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size);
+    std::string Name(){ return "none"; }
+
+  };
+
+#ifdef ZLIB
+  /**
+   * \class ZlibCodec
+   *
+   * Codec using zlib deflate at a configurable level (0-9, -1 for zlib's default).
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  class ZlibCodec : public Codec{
+
+  public:
+
+    bool Compress(const char* in, unsigned long int size, std::string& out, int level=-1);
+    bool Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size);
+    std::string Name(){ return "zlib"; }
+
+  };
+#endif
+
+  /**
+   * \class FastCodec
+   *
+   * Built in byte oriented LZ77 codec using the LZ4 block sequence layout (token, literals, 16 bit offset, match length). It trades compression ratio for speed and has no external dependency. The level is ignored.
+   *
+   * $Author: B.Richards $
+   * $Date: 2024/06/08 1:17:00 $
+   */
+
+  class FastCodec : public Codec{
+
+  public:
+
+    bool Compress(const char* in, unsigned long int size, std::string& out, int level=-1);
+    bool Decompress(const char* in, unsigned long int size, char* out, unsigned long int out_size);
+    std::string Name(){ return "fast"; }
+
+  private:
+
+    static void WriteLength(std::string& out, unsigned long int length); ///< writes the 255 continuation bytes of a length over 15
+
+  };
+
+}
+
+#endif
@@ -117,7 +117,7 @@ namespace ToolFramework {
   
 
   
-  bool Store::Has(std::string key){
+  bool Store::Has(const std::string& key){
     
     return (m_variables.count(key)!=0);
     
@@ -139,17 +139,19 @@ namespace ToolFramework {
   }
   
   
-  bool Store::Get(std::string name, std::string &out){
-    if(m_variables.count(name)>0){ 
-      out=StringStrip(m_variables[name]);
+  bool Store::Get(const std::string& name, std::string &out){
+    std::map<std::string,std::string>::iterator it=m_variables.find(name);
+    if(it!=m_variables.end()){ 
+      out=StringStrip(it->second);
       return true;
     }
     return false;
   }
   
-  bool Store::Get(std::string name, bool &out){
-    if(m_variables.count(name)>0){
-      std::string tmp=StringStrip(m_variables[name]);
+  bool Store::Get(const std::string& name, bool &out){
+    std::map<std::string,std::string>::iterator it=m_variables.find(name);
+    if(it!=m_variables.end()){
+      std::string tmp=StringStrip(it->second);
       if(tmp=="true") out=true;
       else if(tmp=="false") out=false;
       else if(tmp=="" || tmp=="0") out=false;
@@ -161,50 +163,67 @@ namespace ToolFramework {
     
   }
   
-  bool Store::Get(std::string name, Store &out){
-    if(m_variables.count(name)>0 && StringStrip(m_variables[name])[0]=='{'){
-      out.JsonParser(StringStrip(m_variables[name]));
+  bool Store::Get(const std::string& name, Store &out){
+    std::map<std::string,std::string>::iterator it=m_variables.find(name);
+    if(it!=m_variables.end() && StringStrip(it->second)[0]=='{'){
+      out.JsonParser(StringStrip(it->second));
       return true;
     }
     return false;
     
   }
   
-  void Store::Set(std::string name, std::string in){
-    std::stringstream stream;
-    stream<<"\""<<in<<"\"";
-    m_variables[name]=stream.str();
+  void Store::Set(const std::string& name, const std::string& in){
+    std::string& value=m_variables[name];
+    if(&value==&in){ // setting a key to its own value
+      value.insert(value.begin(), '"');
+      value+='"';
+      return;
+    }
+    value.reserve(in.length()+2);
+    value='"';
+    value+=in;
+    value+='"';
+  }
+  
+  void Store::Set(const std::string& name, std::string&& in){
+    in.insert(in.begin(), '"');
+    in+='"';
+    std::string& value=m_variables[name];
+    if(&value!=&in) value=std::move(in); // a key set to its own value is already quoted in place
   }
   
-  void Store::Set(std::string name, const char* in){
-    std::stringstream stream;
-    stream<<"\""<<in<<"\"";
-    m_variables[name]=stream.str();
+  void Store::Set(const std::string& name, const char* in){
+    std::string& value=m_variables[name];
+    value='"';
+    value+=in;
+    value+='"';
   }
   
-  void Store::Set(std::string name,std::vector<std::string> in){
-    std::stringstream stream;
-    std::string tmp="[";
+  void Store::Set(const std::string& name,const std::vector<std::string>& in){
+    size_t length=2;
+    for(unsigned int i=0; i<in.size(); i++) length+=in[i].length()+3;
+    std::string& value=m_variables[name];
+    value.reserve(length);
+    value='[';
     for(unsigned int i=0; i<in.size(); i++){
-      stream<<"\""<<in.at(i)<<"\"";
-      tmp+=stream.str();
-      if(i!=in.size()-1)tmp+=',';
-      stream.str("");
-      stream.clear();
+      if(i) value+=',';
+      value+='"';
+      value+=in[i];
+      value+='"';
     }
-    tmp+=']';
-    m_variables[name]=tmp;
+    value+=']';
     
   }
   
-  std::string Store::StringStrip(std::string in){
+  std::string Store::StringStrip(const std::string& in){
     
     if(in.length() && in[0]=='"' && in[in.length()-1]=='"') return in.substr(1,in.length()-2);
     return in;
     
   }
   
-  bool Store::Destring(std::string key){
+  bool Store::Destring(const std::string& key){
     
     if(!m_variables.count(key)) return false;
     m_variables[key]=StringStrip(m_variables[key]);
@@ -226,7 +245,7 @@ namespace ToolFramework {
   
   
   
-  bool Store::Erase(std::string key){
+  bool Store::Erase(const std::string& key){
     
     return m_variables.erase(key);
   
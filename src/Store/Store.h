@@ -29,10 +29,10 @@ namespace ToolFramework{
     void JsonParser(std::string input); ///<  Converts a flat JSON formatted string to Store entries in the form of key value pairs.  @param input The input flat JSON string.
     void Print(); ///< Prints the contents of the Store.
     void Delete(); ///< Deletes all entries in the Store.
-    bool Has(std::string key); ///<Returns bool based on if store contains entry given by sting @param string key to comapre.
+    bool Has(const std::string& key); ///<Returns bool based on if store contains entry given by sting @param string key to comapre.
     std::vector<std::string> Keys(); //returns a vector of the keys
-    bool Destring(std::string key); //convers an element from a string by stripping the speachmarks @param string key to comapre.
-    bool Erase(std::string key);
+    bool Destring(const std::string& key); //convers an element from a string by stripping the speachmarks @param string key to comapre.
+    bool Erase(const std::string& key);
     
     /**
        Templated getter function for sore content. Assignment is templated and via reference.
@@ -40,11 +40,12 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and correctly assigned to out and false if not.
     */
-    template<typename T> bool Get(std::string name,T &out){
+    template<typename T> bool Get(const std::string& name,T &out){
       
-      if(m_variables.count(name)>0){
+      std::map<std::string,std::string>::iterator it=m_variables.find(name);
+      if(it!=m_variables.end()){
 	
-	std::stringstream stream(StringStrip(m_variables[name]));
+	std::stringstream stream(StringStrip(it->second));
 	stream>>out;
 	return !stream.fail();
       }
@@ -59,11 +60,13 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and correctly assigned to out and false if not.
     */
-    template<typename T> bool Get(std::string name,std::vector<T> &out){
+    template<typename T> bool Get(const std::string& name,std::vector<T> &out){
 
-      std::string stripped = StringStrip(m_variables[name]);
+      std::map<std::string,std::string>::iterator it=m_variables.find(name);
+      if(it==m_variables.end()) return false;
+      std::string stripped = StringStrip(it->second);
 
-      if(m_variables.count(name)>0 && stripped[0]=='['){
+      if(stripped[0]=='['){
 	std::stringstream stream;
 	out.clear();
 	  
@@ -98,7 +101,7 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and correctly assigned to out and false if not.
     */
-    bool Get(std::string name, std::string &out);
+    bool Get(const std::string& name, std::string &out);
 
         /**
        getter function for bool content..
@@ -106,7 +109,7 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and correctly assigned to out and false if not.
     */
-    bool Get(std::string name, bool &out);
+    bool Get(const std::string& name, bool &out);
 
         /**
        getter function for store content..
@@ -114,7 +117,7 @@ namespace ToolFramework{
        @param out The variable to fill with the value.
        @return Return value is true if varaible exists in the Store and correctly assigned to out and false if not.
     */
-    bool Get(std::string name, Store &out);
+    bool Get(const std::string& name, Store &out);
 
     
     /**
@@ -122,7 +125,7 @@ namespace ToolFramework{
        @param name The ASCII key that the variable in the Store is stored with.
        @return Return value is default copiler costructed value if not true (note: no checking exists)
     */
-    template<typename T> T Get(std::string name){
+    template<typename T> T Get(const std::string& name){
       
       T tmp;
       if(!Get(name,tmp)) std::cout<<"\033[38;5;196mERROR: Store doesnt hold value \""<<name<<"\" default returned\033[0m"<<std::endl;
@@ -138,7 +141,7 @@ namespace ToolFramework{
        @param name The key to be used to store and reference the variable in the Store.
        @param in the varaible to be stored.
     */
-    template<typename T> void Set(std::string name,T in){
+    template<typename T> void Set(const std::string& name,const T& in){
       std::stringstream stream;
       stream<<in;
       m_variables[name]=stream.str();
@@ -150,7 +153,15 @@ namespace ToolFramework{
        @param in the varaible to be stored.
     */
 
-    void Set(std::string name, std::string in);
+    void Set(const std::string& name, const std::string& in);
+
+    /**
+       string setter function to assign vairables in the Store, reusing the string's memory for the stored value.
+       @param name The key to be used to store and reference the variable in the Store.
+       @param in the varaible to be stored.
+    */
+
+    void Set(const std::string& name, std::string&& in);
 
     /**
        string setter function to assign vairables in the Store.
@@ -158,7 +169,7 @@ namespace ToolFramework{
        @param in the varaible to be stored.
     */
 
-    void Set(std::string name, const char* in);
+    void Set(const std::string& name, const char* in);
 
     /**
        Templated setter function to assign vairables in the Store from a vector.
@@ -166,19 +177,16 @@ namespace ToolFramework{
        @param in the varaible to be stored.
     */
     
-    template<typename T> void Set(std::string name,std::vector<T> in){
+    template<typename T> void Set(const std::string& name,const std::vector<T>& in){
      
       std::stringstream stream;
-      std::string tmp="[";
+      stream<<'[';
       for(unsigned int i=0; i<in.size(); i++){
-	stream<<in.at(i);
-	tmp+=stream.str();
-	if(i!=in.size()-1)tmp+=',';
-	stream.str("");
-	stream.clear();	
+	if(i) stream<<',';
+	stream<<in[i];
       }
-      tmp+=']';
-      m_variables[name]=tmp;
+      stream<<']';
+      m_variables[name]=stream.str();
       
     }
 
@@ -188,13 +196,13 @@ namespace ToolFramework{
        @param in the varaible to be stored.
     */
     
-    void Set(std::string name,std::vector<std::string> in);
+    void Set(const std::string& name,const std::vector<std::string>& in);
     /**
        Returns string pointer to Store element.
        @param key The key of the string pointer to return.
        @return a pointer to the string version of the value within the Store.
     */
-    std::string* operator[](std::string key){
+    std::string* operator[](const std::string& key){
       return &m_variables[key];
     }
     
@@ -228,7 +236,7 @@ namespace ToolFramework{
     
     
     std::map<std::string,std::string> m_variables;
-    std::string StringStrip(std::string in);
+    std::string StringStrip(const std::string& in);
     
   };
   
@@ -5,9 +5,6 @@
 #include <SerialisableObject.h>
 
 
-
-//fixme use zie_t for sizes but have todo in binary stream as well;
-
 namespace ToolFramework{
 
   class Tag : public SerialisableObject{
@@ -30,7 +27,10 @@ namespace ToolFramework{
 
       if(!(bs & type)) return false;
       if(!(bs & version)) return false;
-      if(!(bs & size)) return false;
+      if(bs.m_write) return bs.WriteSize(size); // size is the length prefix of the serialised object that follows
+      uint64_t tmp=0;
+      if(!bs.ReadSize(tmp)) return false;
+      size=tmp;
 
       return true;
     }
@@ -50,7 +50,7 @@ namespace ToolFramework{
   public:
 
     virtual std::string GetType()=0;
-    unsigned int GetSize(){
+    size_t GetSize(){
 
       BinaryStream bs;
       Serialise(bs);
@@ -0,0 +1 @@
+/root/repo/DataModel/DataModel.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/UserTools/DummyTool/DummyTool.h
\ No newline at end of file
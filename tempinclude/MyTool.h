@@ -0,0 +1 @@
+/root/repo/UserTools/template/MyTool.h
\ No newline at end of file
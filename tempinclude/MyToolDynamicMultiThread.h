@@ -0,0 +1 @@
+/root/repo/UserTools/template/MyToolDynamicMultiThread.h
\ No newline at end of file
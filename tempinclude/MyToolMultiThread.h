@@ -0,0 +1 @@
+/root/repo/UserTools/template/MyToolMultiThread.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/UserTools/template/MyToolThread.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/UserTools/Unity.h
\ No newline at end of file